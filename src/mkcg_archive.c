@@ -0,0 +1,406 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+#if HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+/*
+ * Glyph sets are shipped as tar archives of the data/CG_* directories.
+ * The archive is read in one sequential pass, from a file or stdin, and
+ * every *.xpm member goes straight into the buffer of a new character,
+ * nothing is extracted.  With zlib the stream may be gzip compressed,
+ * gzread() passes an uncompressed stream through unchanged.  Only
+ * ustar, GNU long names and pax path records are understood, that is
+ * all tar(1) writes for such a tree.
+ */
+#define TAR_BLOCK	512
+#define TAR_BUFFER	(128 * 1024)
+
+typedef struct {
+
+	int		fd;
+#if HAVE_ZLIB
+	gzFile		gz;
+#endif
+	bool		eof;
+
+} _mkcg_archive_stream;
+
+static bool _mkcg_archive_read(_mkcg_archive_stream *stream, void *buf,
+		size_t len)
+{
+	size_t	done = 0;
+	ssize_t	got;
+
+	while (done < len) {
+#if HAVE_ZLIB
+		got = gzread(stream->gz, (char *)buf + done, len - done);
+#else
+		got = read(stream->fd, (char *)buf + done, len - done);
+		if (got < 0 && errno == EINTR)
+			continue;
+#endif
+		if (got <= 0) {
+			stream->eof = true;
+			return false;
+		}
+		done += got;
+	}
+
+	return true;
+}
+
+/* Read LEN bytes of member data plus the padding up to the next block. */
+static char *_mkcg_archive_data(_mkcg_archive_stream *stream, size_t len)
+{
+	char	pad[TAR_BLOCK];
+	char	*buf;
+	size_t	rest = (TAR_BLOCK - len % TAR_BLOCK) % TAR_BLOCK;
+
+	if (!(buf = (char *)malloc(len + 1)))
+		return (char *)NULL;
+
+	if (!_mkcg_archive_read(stream, buf, len) ||
+	    !_mkcg_archive_read(stream, pad, rest)) {
+		free(buf);
+		return (char *)NULL;
+	}
+
+	buf[len] = '\0';
+	return buf;
+}
+
+static bool _mkcg_archive_skip(_mkcg_archive_stream *stream, size_t len)
+{
+	char	buf[TAR_BLOCK];
+	size_t	cnt;
+
+	for (cnt = 0; cnt < (len + TAR_BLOCK - 1) / TAR_BLOCK; cnt++)
+		if (!_mkcg_archive_read(stream, buf, TAR_BLOCK))
+			return false;
+
+	return true;
+}
+
+static unsigned long long _mkcg_archive_number(const unsigned char *field,
+		size_t len)
+{
+	unsigned long long	value = 0;
+	size_t			cnt;
+
+	/* GNU base-256 for large values */
+	if (field[0] & 0x80) {
+		for (value = field[0] & 0x7F, cnt = 1; cnt < len; cnt++)
+			value = (value << 8) | field[cnt];
+		return value;
+	}
+
+	for (cnt = 0; cnt < len && field[cnt] == ' '; cnt++);
+	for (; cnt < len && field[cnt] >= '0' && field[cnt] <= '7'; cnt++)
+		value = (value << 3) | (field[cnt] - '0');
+
+	return value;
+}
+
+static bool _mkcg_archive_checksum(const unsigned char *block)
+{
+	unsigned long	sum = 0;
+	unsigned int	cnt;
+
+	for (cnt = 0; cnt < TAR_BLOCK; cnt++)
+		sum += (cnt >= 148 && cnt < 156) ? ' ' : block[cnt];
+
+	return sum == _mkcg_archive_number(&block[148], 8);
+}
+
+/* Return the path out of pax extended header records, if any. */
+static char *_mkcg_archive_pax_path(char *data, size_t len)
+{
+	char	*pos = data, *end = data + len, *rec;
+	size_t	reclen;
+
+	while (pos < end) {
+		reclen = strtoul(pos, &rec, 10);
+		if (!reclen || (rec >= end) || (*rec != ' ') || (pos + reclen > end))
+			break;
+		rec++;
+		if (!strncmp(rec, "path=", 5)) {
+			pos[reclen - 1] = '\0';
+			return strdup(rec + 5);
+		}
+		pos += reclen;
+	}
+
+	return (char *)NULL;
+}
+
+static bool _mkcg_archive_wanted(mkcg_cg *cg, const char *path)
+{
+	const char	*arg, *base;
+	size_t		cnt, len = strlen(path);
+
+	if ((len < 4) || strcmp(&path[len - 4], ".xpm"))
+		return false;
+
+	if (!cg->opt_files_number)
+		return true;
+
+	/* a MEMBER argument is one *.xpm member or a directory, as the
+	 * shell would expand all *.xpm of it on extracted files */
+	while (!strncmp(path, "./", 2))
+		path += 2;
+	base = strrchr(path, '/');
+	len  = base ? (size_t)(base - path) : 0;
+
+	for (cnt = 0; cnt < cg->opt_files_number; cnt++) {
+
+		for (arg = cg->opt_files[cnt]; !strncmp(arg, "./", 2); arg += 2);
+
+		if (!strcmp(path, arg))
+			return true;
+
+		if (!strncmp(path, arg, len) && ((arg[len] == '\0') ||
+		    ((arg[len] == '/') && (arg[len + 1] == '\0'))))
+			return true;
+	}
+
+	return false;
+}
+
+/* Code point of an ascii_0xNN.xpm member, members without one go last. */
+unsigned long mkcg_archive_code(const char *path)
+{
+	const char	*base = strrchr(path, '/');
+	char		*end;
+	unsigned long	code;
+
+	base = base ? base + 1 : path;
+	if (strncmp(base, "ascii_0x", 8))
+		return ~0UL;
+
+	code = strtoul(base + 8, &end, 16);
+	return (end != base + 8) && !strcmp(end, ".xpm") ? code : ~0UL;
+}
+
+/*
+ * An archive may hold several character sets, one per directory.  The
+ * members are kept together by directory, so the sets follow each
+ * other, and only within a directory ordered by code point.
+ */
+static int _mkcg_archive_cmp(const void *a, const void *b)
+{
+	const mkcg_ch	*ca = (const mkcg_ch *)a;
+	const mkcg_ch	*cb = (const mkcg_ch *)b;
+	const char	*base_a = strrchr(ca->filename, '/');
+	const char	*base_b = strrchr(cb->filename, '/');
+	size_t		dir_a = base_a ? (size_t)(base_a - ca->filename) : 0;
+	size_t		dir_b = base_b ? (size_t)(base_b - cb->filename) : 0;
+	unsigned long	code_a, code_b;
+	int		cmp;
+
+	if ((cmp = strncmp(ca->filename, cb->filename,
+			dir_a < dir_b ? dir_a : dir_b)))
+		return cmp;
+	if (dir_a != dir_b)
+		return dir_a < dir_b ? -1 : 1;
+
+	code_a = mkcg_archive_code(ca->filename);
+	code_b = mkcg_archive_code(cb->filename);
+	if (code_a != code_b)
+		return code_a < code_b ? -1 : 1;
+	return strcmp(ca->filename, cb->filename);
+}
+
+static bool _mkcg_archive_add(mkcg_cg *cg, size_t *alloc, char *path,
+		char *data, size_t len)
+{
+	mkcg_ch	*ch;
+
+	if (cg->number == *alloc) {
+		*alloc = *alloc ? *alloc * 2 : 256;
+		if (!(ch = (mkcg_ch *)realloc(cg->ch, *alloc * sizeof(mkcg_ch))))
+			return false;
+		cg->ch = ch;
+	}
+
+	ch = &cg->ch[cg->number++];
+	memset((void *)ch, 0, sizeof(mkcg_ch));
+	ch->filename	= path;
+	ch->buffer	= data;
+	ch->size	= len;
+
+	return true;
+}
+
+static bool _mkcg_archive_walk(mkcg_cg *cg, _mkcg_archive_stream *stream)
+{
+	unsigned char		block[TAR_BLOCK];
+	unsigned long long	len;
+	char			*path, *longname = (char *)NULL, *data;
+	size_t			alloc = 0;
+	unsigned int		zero = 0;
+	bool			ret = true;
+
+	while (ret && (zero < 2) && _mkcg_archive_read(stream, block, TAR_BLOCK)) {
+
+		if (!block[0]) {
+			zero++;
+			continue;
+		}
+		zero = 0;
+
+		if (!_mkcg_archive_checksum(block)) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("%s", "archive: no tar header, wrong format");
+			ret = false;
+			break;
+		}
+
+		len = _mkcg_archive_number(&block[124], 12);
+
+		switch (block[156]) {
+
+			case 'L':	/* GNU long name of the next member */
+			case 'x':	/* pax extended header of the next member */
+				if (!(data = _mkcg_archive_data(stream, len))) {
+					ret = false;
+					break;
+				}
+				if (longname) free(longname);
+				longname = block[156] == 'L' ?
+					strdup(data) : _mkcg_archive_pax_path(data, len);
+				free(data);
+				break;
+
+			case '0':
+			case '\0':
+				if (longname) {
+					path = longname;
+					longname = (char *)NULL;
+				} else if (!strncmp((char *)&block[257], "ustar", 5) &&
+						block[345]) {
+					if ((path = (char *)malloc(155 + 1 + 100 + 1)))
+						snprintf(path, 155 + 1 + 100 + 1, "%.155s/%.100s",
+								&block[345], &block[0]);
+				} else
+					path = strndup((char *)&block[0], 100);
+
+				if (!path) {
+					ret = false;
+					break;
+				}
+
+				if (!_mkcg_archive_wanted(cg, path)) {
+					free(path);
+					ret = _mkcg_archive_skip(stream, len);
+					break;
+				}
+
+				if (!(data = _mkcg_archive_data(stream, len)) ||
+				    !_mkcg_archive_add(cg, &alloc, path, data, len)) {
+					if (data) free(data);
+					free(path);
+					ret = false;
+				}
+				break;
+
+			default:	/* directories, links and the like */
+				if (longname) free(longname);
+				longname = (char *)NULL;
+				ret = _mkcg_archive_skip(stream, len);
+				break;
+		}
+	}
+
+	if (longname) free(longname);
+
+	/* tar ends with two zero blocks, anything else was cut off */
+	if ((ret || stream->eof) && (zero < 2)) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("%s", "archive: truncated");
+		ret = false;
+	}
+
+	return ret;
+}
+
+/* Load all selected members of the archive as the character set. */
+bool mkcg_archive_read(mkcg_cg *cg)
+{
+	_mkcg_archive_stream	stream;
+	bool			ret;
+
+	memset((void *)&stream, 0, sizeof(stream));
+
+	if (!strcmp(cg->opt_archive, "-"))
+		stream.fd = dup(STDIN_FILENO);
+	else
+		stream.fd = open(cg->opt_archive, O_RDONLY);
+
+	if (stream.fd < 0) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("can not open archive: %s", cg->opt_archive);
+		return false;
+	}
+
+#if HAVE_ZLIB
+	if (!(stream.gz = gzdopen(stream.fd, "rb"))) {
+		close(stream.fd);
+		return false;
+	}
+	gzbuffer(stream.gz, TAR_BUFFER);
+#else
+	{
+		unsigned char magic[2];
+
+		if ((pread(stream.fd, magic, 2, 0) == 2) &&
+		    (magic[0] == 0x1F) && (magic[1] == 0x8B)) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("%s", "archive: gzip needs zlib support");
+			close(stream.fd);
+			return false;
+		}
+	}
+#endif
+
+	ret = _mkcg_archive_walk(cg, &stream);
+
+#if HAVE_ZLIB
+	gzclose(stream.gz);
+#else
+	close(stream.fd);
+#endif
+
+	/* no member at all is rejected by the caller like an empty file list */
+	if (ret && cg->number)
+		qsort(cg->ch, cg->number, sizeof(mkcg_ch), _mkcg_archive_cmp);
+
+	if (cg->options & OPT_MKCG_VERBOSE)
+		INF("archive: %s, %zu members", cg->opt_archive, cg->number);
+
+	return ret;
+}
@@ -27,26 +27,52 @@
 # error missing GNU extension to parse command-line options
 #endif
 
-static const char *_mkcg_optstring_noneg = ":bho::qxvV";
+static const char *_mkcg_optstring_noneg = ":a:bCd:e:g:hjlL:o::qr::R:s:S::T:xvV";
 static const struct option _mkcg_options_noneg[] = {
+	{"archive",	required_argument,	0, 'a'},
 	{"banner",	no_argument,		0, 'b'},
+	{"container",	no_argument,		0, 'C'},
+	{"derive",	required_argument,	0, 'd'},
+	{"endian",	required_argument,	0, 'e'},
+	{"geometry",	required_argument,	0, 'g'},
 	{"help",	no_argument,		0, 'h'},
 	{"hexdump",	no_argument,		0, 'x'},
+	{"json",	no_argument,		0, 'j'},
+	{"layout",	required_argument,	0, 'L'},
+	{"lint",	no_argument,		0, 'l'},
 	{"overview",	optional_argument,	0, 'o'},
 	{"quiet",	no_argument,		0, 'q'},
+	{"render",	optional_argument,	0, 'r'},
+	{"render-output", required_argument,	0, 'R'},
+	{"screen",	required_argument,	0, 's'},
+	{"similar",	optional_argument,	0, 'S'},
+	{"trace",	required_argument,	0, 'T'},
 	{"verbose",	no_argument,		0, 'v'},
 	{"version",	no_argument,		0, 'V'},
 	{0, 0, 0, 0},
 };
 
-static const char *_mkcg_optstring_neg = ":bhno::qxvV";
+static const char *_mkcg_optstring_neg = ":a:bCd:e:g:hjlL:no::qr::R:s:S::T:xvV";
 static const struct option _mkcg_options_neg[] = {
+	{"archive",	required_argument,	0, 'a'},
 	{"banner",	no_argument,		0, 'b'},
+	{"container",	no_argument,		0, 'C'},
+	{"derive",	required_argument,	0, 'd'},
+	{"endian",	required_argument,	0, 'e'},
+	{"geometry",	required_argument,	0, 'g'},
 	{"help",	no_argument,		0, 'h'},
 	{"hexdump",	no_argument,		0, 'x'},
+	{"json",	no_argument,		0, 'j'},
+	{"layout",	required_argument,	0, 'L'},
+	{"lint",	no_argument,		0, 'l'},
 	{"neg",		no_argument,		0, 'n'},
 	{"overview",	optional_argument,	0, 'o'},
 	{"quiet",	no_argument,		0, 'q'},
+	{"render",	optional_argument,	0, 'r'},
+	{"render-output", required_argument,	0, 'R'},
+	{"screen",	required_argument,	0, 's'},
+	{"similar",	optional_argument,	0, 'S'},
+	{"trace",	required_argument,	0, 'T'},
 	{"verbose",	no_argument,		0, 'v'},
 	{"version",	no_argument,		0, 'V'},
 	{0, 0, 0, 0},
@@ -59,91 +85,122 @@ static void _mkcg_print_help(mkcg_cg *cg)
 {
 	/* TRANSLATORS: --help output 1 (synopsis)
 	 * no-wrap */
-	OUT("\
-Usage: %s [OPTION]... XPMFILE...\n",
+	OUT(cg, "\
+Usage: %s [OPTION]... XPMFILE...\n\
+  or:  %s --archive=ARCHIVE [OPTION]... [MEMBER]...\n\
+  or:  %s --lint [OPTION]... XPMFILE|DIR...\n",
+		cg->progname ? cg->progname : "no programm",
+		cg->progname ? cg->progname : "no programm",
 		cg->progname ? cg->progname : "no programm");
 
 	/* TRANSLATORS: --help output 2 (brief description)
 	 * no-wrap */
-	OUT("\n%s", cg->description ? cg->description : "no description");
+	OUT(cg, "\n%s", cg->description ? cg->description : "no description");
 
 	/* TRANSLATORS: --help output 3 (options 1/4)
 	 * no-wrap */
-	OUT("%s", "\n\
+	OUT(cg, "%s", "\n\
 Options:\n\
   -h, --help     display this help and exit\n\
   -V, --version  display version information and exit\n");
 
 	/* TRANSLATORS: --help output 4 (options 2/4)
 	 * no-wrap */
-	OUT("%s", "\n\
+	OUT(cg, "%s", "\n\
   -q, --quiet    don't report any errors\n\
   -v, --verbose  show more progress information on stderr\n");
 
 	/* TRANSLATORS: --help output 5 (options 3/4)
 	 * no-wrap */
-	OUT("%s", "\n\
+	OUT(cg, "%s", "\n\
   -x, --hexdump  make xxd conform hexdump (default)\n\
   -b, --banner   make banner dump\n\
   -o[COLS], --overview[=COLS]\n\
-                 make a new pixmap with all XPMFILEs merged together\n");
+                 make a new pixmap with all XPMFILEs merged together\n\
+  -r[FMT], --render[=FMT]\n\
+                 render video RAM dumps with all XPMFILEs as charset,\n\
+                 one image per screen frame, FMT is xpm (default) or pbm\n\
+  -R PATTERN, --render-output=PATTERN\n\
+                 write every frame to a file of its own, PATTERN holds\n\
+                 one %u for the frame number (e.g. frame_%05u.xpm),\n\
+                 without it only PBM takes more than one frame\n\
+  -s FILE, --screen=FILE\n\
+                 video RAM dump to render, '-' for stdin (repeatable)\n\
+  -l, --lint     validate the XPM head of all XPMFILEs and all *.xpm\n\
+                 found in DIRs, report every violation and continue\n\
+  -S[DIST], --similar[=DIST]\n\
+                 report all pairs of XPMFILEs that differ in at most\n\
+                 DIST pixels (default 2), 0 lists exact duplicates\n\
+  -j, --json     report in JSON instead of a table (similar)\n\
+  -C, --container\n\
+                 write all XPMFILEs as binary glyph set container, every\n\
+                 action takes it in place of or mixed with XPMFILEs\n");
 
 	/* TRANSLATORS: --help output 6 (options 4/4)
 	 * no-wrap */
 	if (!(cg->options & OPT_MKCG_NEGATED)) {
-		OUT("%s", "\n\
+		OUT(cg, "%s", "\n\
   -n, --neg      negated (inverse) output (banner and hexdump)\n");
 	}
+	OUT(cg, "%s", "\n\
+  -d OPS, --derive=OPS\n\
+                 append a bank derived from all XPMFILEs, OPS is a comma\n\
+                 separated list of neg, ul[=ROW], bold, mirror, dhtop\n\
+                 and dhbottom (repeatable, one bank each)\n\
+  -g GEOMETRY, --geometry=GEOMETRY\n\
+                 glyph size WIDTHxHIGHT instead of the board default,\n\
+                 up to 32x32, optional :BITSxROWS bounds every glyph\n\
+                 to BITS (default WIDTH) x ROWS (default HIGHT) in ROM\n\
+  -e ORDER, --endian=ORDER\n\
+                 byte order of rows wider than 8 bits, big (default,\n\
+                 most significant byte first) or little\n\
+  -L FORMULA, --layout=FORMULA\n\
+                 ROM address layout of the hexdump, glyph (default),\n\
+                 scanline or a comma separated list of char:BITS,\n\
+                 bank:BITS, row:BITS and byte:BITS from the most\n\
+                 significant address bit down, a leading select:BITS\n\
+                 writes one dump per EPROM picked by the top BITS\n\
+  -a ARCHIVE, --archive=ARCHIVE\n\
+                 read the XPMFILEs from a tar archive, gzip compressed\n\
+                 or not, '-' for stdin, directory by directory in the\n\
+                 order of their ascii_0xNN code point, a MEMBER selects\n\
+                 one *.xpm member or all of one directory\n\
+  -T FILE, --trace=FILE\n\
+                 write the time spans of every glyph (read, parse,\n\
+                 validate, encode) and of the action to FILE as Chrome\n\
+                 trace-event JSON\n");
 
 	/* TRANSLATORS: --help output 6 (end)
 	 * TRANSLATORS: the placeholder indicates the bug-reporting address
 	 * for this application.  Please add _another line_ with the
 	 * address for translation bugs.
 	 * no-wrap */
-	OUT("\n\
+	OUT(cg, "\n\
 Report bugs to <%s>\n", PACKAGE_BUGREPORT);
-	OUT("\
+	OUT(cg, "\
 %s home page: <%s>\n", PACKAGE_NAME, PACKAGE_URL);
 }
 
 /* Print version and copyright information.  */
 static void _mkcg_print_version(mkcg_cg *cg)
 {
-	OUT("%s (%s) %s\n", cg->progname, PACKAGE, VERSION);
+	OUT(cg, "%s (%s) %s\n", cg->progname, PACKAGE, VERSION);
 	/* xgettext: no-wrap */
-	OUT("%s", "\n");
+	OUT(cg, "%s", "\n");
 
 	/* It is important to separate the year from the rest of the message,
 	 * as done here, to avoid having to retranslate the message when a new
 	 * year comes around.  */
-	OUT("\
+	OUT(cg, "\
 Copyright (C) 2002-%d %s\n\
 License: GNU GPL v2+ <http://www.gnu.org/licenses/gpl.html>\n\
 This is free software.  There is NO WARRANTY, to the extent permitted by law.\n",
               COPYRIGHT_YEAR, "Li-Pro.Net");
 }
 
-/* Exit status codes:
- * null     if full success
- * positive if partial success
- * negative if failure
- */
-#define PCMT_EXSTAT_XPM_CE	(XpmColorError)	/* XpmColorError = 1 */
-#define PCMT_EXSTAT_OK		(XpmSuccess)	/* XpmSuccess = 0 */
-#define PCMT_EXSTAT_XPM_OF	(XpmOpenFailed)	/* XpmOpenFailed = -1 */
-#define PCMT_EXSTAT_XPM_FI	(XpmFileInvalid)/* XpmFileInvalid = -2 */
-#define PCMT_EXSTAT_XPM_NM	(XpmNoMemory)	/* XpmNoMemory = -3 */
-#define PCMT_EXSTAT_XPM_CF	(XpmColorFailed)/* XpmColorFailed = -4 */
-#define PCMT_EXSTAT_WRONGOPT	(-10)
-#define PCMT_EXSTAT_NOFILES	(-11)
-#define PCMT_EXSTAT_NOMEM	(-12)
-#define PCMT_EXSTAT_CONVERR	(-13)
-#define PCMT_EXSTAT_CRITERR	(-20)
-
-static void _mkcg_exit_func(int status, void *arg)
+/* Print the message of a status, if any.  */
+void mkcg_report(mkcg_cg *cg, int status)
 {
-	mkcg_cg	*cg = (mkcg_cg *)arg;
-
 	switch (status) {
 
 		case PCMT_EXSTAT_WRONGOPT:
@@ -170,6 +227,11 @@ static void _mkcg_exit_func(int status, void *arg)
 				ERR("%s\n", "internal conversion error");
 			break;
 
+		case PCMT_EXSTAT_IOERR:
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("%s\n", "input/output error");
+			break;
+
 		case PCMT_EXSTAT_XPM_CE:
 			if (!(cg->options & OPT_MKCG_QUIET))
 				ERR("%s\n", "XPM: color error");
@@ -198,17 +260,101 @@ static void _mkcg_exit_func(int status, void *arg)
 		default:
 			break;
 	}
+}
+
+/* Release the loaded character set, keep the options.  */
+static void _mkcg_release(mkcg_cg *cg)
+{
+	size_t cnt;
+
+	if (cg->ch) {
+		for (cnt = 0; cnt < cg->number; cnt++) {
+			if (cg->ch[cnt].buffer) free(cg->ch[cnt].buffer);
+			/* member names of an archive belong to the context */
+			if (cg->opt_archive) free(cg->ch[cnt].filename);
+			XpmFreeXpmImage(&(cg->ch[cnt].image));
+			XpmFreeXpmInfo(&(cg->ch[cnt].info));
+		}
+		free(cg->ch);
+		cg->ch = (mkcg_ch *)NULL;
+	}
+	cg->number = 0;
 
-	if (cg->ch) free(cg->ch);
+	if (cg->rows && !cg->map_rows) free(cg->rows);
+	cg->rows	= NULL;
+	cg->map_rows	= false;
+	cg->banks	= 0;
+
+	mkcg_container_close(cg);
 }
 
-void mkcg_getopt(mkcg_cg *cg, int argc, char **argv)
+/*
+ * A context owns all its state and memory, so any number of them can
+ * be processed at the same time on separate threads.  The profile
+ * (bounds, expected size, colors) is set by the caller after init.
+ */
+void mkcg_init(mkcg_cg *cg)
+{
+	memset((void *)cg, 0, sizeof(mkcg_cg));
+	cg->out = stdout;
+}
+
+void mkcg_free(mkcg_cg *cg)
 {
-	on_exit(_mkcg_exit_func, (void *)cg);
+	_mkcg_release(cg);
+
+	if (cg->opt_screen_files) free(cg->opt_screen_files);
+	if (cg->opt_derive) free(cg->opt_derive);
+	if (cg->opt_layout) free(cg->opt_layout);
+	if (cg->trace) free(cg->trace);
+
+	cg->opt_screen_files	= (char **)NULL;
+	cg->opt_screen_number	= 0;
+	cg->opt_derive		= (mkcg_derive *)NULL;
+	cg->opt_derive_number	= 0;
+	cg->opt_layout		= (mkcg_layout *)NULL;
+	cg->trace		= (mkcg_trace_event *)NULL;
+	cg->trace_alloc		= 0;
+}
+
+/* Parse --geometry=WIDTHxHIGHT[:BITSxROWS] into the profile.  */
+static bool _mkcg_geometry_parse(mkcg_cg *cg, const char *spec)
+{
+	unsigned int	width, hight, bits, rows;
+	int		len = 0;
+
+	if (sscanf(spec, "%ux%u%n", &width, &hight, &len) != 2)
+		return false;
+
+	bits = width;
+	rows = hight;
+	if (spec[len] == ':') {
+		spec += len + 1;
+		len = 0;
+		if (sscanf(spec, "%ux%u%n", &bits, &rows, &len) != 2)
+			return false;
+	}
 
+	if (spec[len] || !width || !hight || (width > bits) || (bits > 32) ||
+	    (hight > rows) || (rows > 32))
+		return false;
+
+	cg->exp_ch_width	= width;
+	cg->exp_ch_hight	= hight;
+	cg->bound_bits		= bits;
+	cg->bound_bytes		= rows;
+
+	return true;
+}
+
+/* The command line parser is built on getopt_long(3) and its global
+ * state, it belongs to the main thread.  All other functions only work
+ * on the given context.  */
+int mkcg_getopt(mkcg_cg *cg, int argc, char **argv)
+{
 	while (true) {
-		static const char *optstring;
-		static const struct option *long_options;
+		const char *optstring;
+		const struct option *long_options;
 		int option_index = 0;
 		int c;
 
@@ -235,6 +381,16 @@ void mkcg_getopt(mkcg_cg *cg, int argc, char **argv)
 					cg->options : OPT_MKCG_HEXDUMP;
 				break;
 
+			case 'l':
+				cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ?
+					cg->options : OPT_MKCG_LINT;
+				break;
+
+			case 'C':
+				cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ?
+					cg->options : OPT_MKCG_CONTAINER;
+				break;
+
 			case 'o':
 				cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ?
 					cg->options : OPT_MKCG_OVERVIEW;
@@ -244,6 +400,77 @@ void mkcg_getopt(mkcg_cg *cg, int argc, char **argv)
 					cg->opt_overview_cols = 16;
 				break;
 
+			case 'r':
+				cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ?
+					cg->options : OPT_MKCG_RENDER;
+				if ((optarg == NULL) || (strcmp(optarg, "xpm") == 0))
+					cg->opt_render_format = MKCG_RENDER_XPM;
+				else if (strcmp(optarg, "pbm") == 0)
+					cg->opt_render_format = MKCG_RENDER_PBM;
+				else
+					return PCMT_EXSTAT_WRONGOPT;
+				break;
+
+			case 'R':
+				if (!mkcg_screen_parse(cg, optarg))
+					return PCMT_EXSTAT_WRONGOPT;
+				break;
+
+			case 's': {
+				char **files = (char **)realloc(cg->opt_screen_files,
+						(cg->opt_screen_number + 1) * sizeof(char *));
+				if (!files)
+					return PCMT_EXSTAT_NOMEM;
+				files[cg->opt_screen_number++] = optarg;
+				cg->opt_screen_files = files;
+				break;
+			}
+
+			case 'S':
+				cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ?
+					cg->options : OPT_MKCG_SIMILAR;
+				if ((optarg != NULL) && isdigit(optarg[0]))
+					cg->opt_similar_dist = atol(optarg);
+				else
+					cg->opt_similar_dist = 2;
+				break;
+
+			case 'j':
+				cg->options |= OPT_MKCG_JSON;
+				break;
+
+			case 'd':
+				if (!mkcg_derive_parse(cg, optarg))
+					return PCMT_EXSTAT_WRONGOPT;
+				break;
+
+			case 'g':
+				if (!_mkcg_geometry_parse(cg, optarg))
+					return PCMT_EXSTAT_WRONGOPT;
+				break;
+
+			case 'e':
+				if (strcmp(optarg, "little") == 0)
+					cg->options |= OPT_MKCG_LITTLEENDIAN;
+				else if (strcmp(optarg, "big") == 0)
+					cg->options &= ~OPT_MKCG_LITTLEENDIAN;
+				else
+					return PCMT_EXSTAT_WRONGOPT;
+				break;
+
+			case 'T':
+				cg->opt_trace_file = optarg;
+				break;
+
+			case 'a':
+				cg->opt_archive = optarg;
+				break;
+
+			case 'L':
+				if (!mkcg_layout_parse(cg, optarg))
+					return PCMT_EXSTAT_WRONGOPT;
+				break;
+
 			case 'n':
 				cg->options |= OPT_MKCG_NEGATED;
 				cg->options |= OPT_MKCG_INVERSE;
@@ -259,88 +486,279 @@ void mkcg_getopt(mkcg_cg *cg, int argc, char **argv)
 
 			case 'V':
 				_mkcg_print_version(cg);
-				exit(EXIT_SUCCESS);
+				return PCMT_EXSTAT_DONE;
 
 			case 'h':
 				_mkcg_print_help(cg);
-				exit(EXIT_SUCCESS);
+				return PCMT_EXSTAT_DONE;
 
 			default:
-				exit(PCMT_EXSTAT_WRONGOPT);
+				return PCMT_EXSTAT_WRONGOPT;
 		}
 	}
+
+	cg->opt_files		= &argv[optind];
+	cg->opt_files_number	= argc - optind;
+
+	return PCMT_EXSTAT_OK;
+}
+
+/* Parse and validate glyph CNT of the set, its buffer is freed.  */
+static int _mkcg_load_glyph(mkcg_cg *cg, size_t cnt)
+{
+	int		status;
+	uint64_t	ts;
+	bool		ok;
+
+	cg->ch[cnt].info.valuemask	= XpmReturnComments
+					| XpmReturnExtensions;
+	MKCG_TRACE_BEGIN(cg, parse, cnt, ts);
+	status = XpmCreateXpmImageFromBuffer(cg->ch[cnt].buffer,
+			&(cg->ch[cnt].image),
+			&(cg->ch[cnt].info));
+	MKCG_TRACE_END(cg, parse, cnt, ts);
+
+	free(cg->ch[cnt].buffer);
+	cg->ch[cnt].buffer = (char *)NULL;
+
+	if (status != XpmSuccess)
+		return status;
+
+	MKCG_TRACE_BEGIN(cg, validate, cnt, ts);
+	ok = mkcg_isvalidch(&(cg->ch[cnt].image), cg, &(cg->ch[cnt]));
+	MKCG_TRACE_END(cg, validate, cnt, ts);
+
+	return ok ? PCMT_EXSTAT_OK : PCMT_EXSTAT_CONVERR;
 }
 
-void mkcg_execopt(mkcg_cg *cg, int argc, char **argv)
+/*
+ * Take a batch of read files into the set and parse it at once, so its
+ * buffers are gone before the next batch is read.  A container puts
+ * its glyphs in its place, so the reads are traced here with the index
+ * each file gets in the set.  LEFT counts the files still to come.
+ */
+static int _mkcg_load_batch(mkcg_cg *cg, mkcg_ch *file, unsigned int count,
+		void *arg)
 {
+	size_t		*left = (size_t *)arg;
 	unsigned int	cnt;
 	int		status;
+	uint64_t	ts;
+	bool		ok;
 
-	cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ? cg->options : OPT_MKCG_HEXDUMP;
+	for (cnt = 0; cnt < count; cnt++) {
 
-	if (optind < argc) {
+		(*left)--;
 
-		cg->number = 0;
-		while (optind < argc) {
-			cg->number++;
-			optind++;
+		/* the file starts at this place, also a container */
+		if (cg->opt_trace_file)
+			mkcg_trace_span(cg, "read", cg->number, file[cnt].filename,
+					file[cnt].read_begin, file[cnt].read_end);
+
+		if (mkcg_container_head(file[cnt].buffer, file[cnt].size)) {
+			MKCG_TRACE_BEGIN(cg, container, -1, ts);
+			ok = mkcg_container_append(cg, &file[cnt], *left);
+			MKCG_TRACE_END(cg, container, -1, ts);
+			if (!ok)
+				return PCMT_EXSTAT_CONVERR;
+			continue;
 		}
 
-		optind -= cg->number;
+		/* the set takes the buffer over */
+		cg->ch[cg->number] = file[cnt];
+		file[cnt].buffer = (char *)NULL;
 
-		if (!(cg->ch = (mkcg_ch *)malloc(cg->number * sizeof(mkcg_ch))))
-			exit(PCMT_EXSTAT_NOMEM);
+		if ((status = _mkcg_load_glyph(cg, cg->number++)) != PCMT_EXSTAT_OK)
+			return status;
+	}
 
-		for (cnt = 0; cnt < cg->number; cnt++) {
+	return PCMT_EXSTAT_OK;
+}
 
-			cg->ch[cnt].filename		= argv[optind++];
-			cg->ch[cnt].info.valuemask	= XpmReturnComments
-							| XpmReturnExtensions;
-			status = XpmReadFileToXpmImage(cg->ch[cnt].filename,
-					&(cg->ch[cnt].image),
-					&(cg->ch[cnt].info));
-			if (status != XpmSuccess)
-				exit(status);
+/* Read, parse, validate and pack the XPMFILEs or archive members.  */
+static int _mkcg_load_xpm(mkcg_cg *cg)
+{
+	size_t		cnt, left;
+	int		status;
+	uint64_t	ts;
+	bool		ok;
 
-			if (!mkcg_isvalidch(&(cg->ch[cnt].image), cg, &(cg->ch[cnt])))
-				exit(PCMT_EXSTAT_CONVERR);
+	if (cg->opt_archive) {
 
-		}
+		MKCG_TRACE_BEGIN(cg, archive, -1, ts);
+		ok = mkcg_archive_read(cg);
+		MKCG_TRACE_END(cg, archive, -1, ts);
+		if (!ok)
+			return PCMT_EXSTAT_IOERR;
 
-		for (cnt = 0; cnt < cg->number; cnt++) {
+		if (!cg->number)
+			return PCMT_EXSTAT_NOFILES;
 
-			if (cg->options & OPT_MKCG_VERBOSE)
-				INF("process: %s ... ", cg->ch[cnt].filename);
+		for (cnt = 0; cnt < cg->number; cnt++)
+			if ((status = _mkcg_load_glyph(cg, cnt)) != PCMT_EXSTAT_OK)
+				return status;
 
-			switch (cg->options & OPT_MKCG_ACTIONMASK) {
+	} else {
 
-				case OPT_MKCG_HEXDUMP:
-					mkcg_out_xxd(cg, &(cg->ch[cnt]), cnt * cg->bound_bytes);
-					break;
+		if (!(cg->ch = (mkcg_ch *)calloc(cg->opt_files_number,
+				sizeof(mkcg_ch))))
+			return PCMT_EXSTAT_NOMEM;
 
-				case OPT_MKCG_BANNER:
-					mkcg_out_banner(cg, &(cg->ch[cnt]));
-					break;
+		left = cg->opt_files_number;
+		status = mkcg_io_readall(cg, cg->opt_files, cg->opt_files_number,
+				_mkcg_load_batch, &left);
+		if (status != PCMT_EXSTAT_OK)
+			return status;
+	}
 
-				case OPT_MKCG_OVERVIEW:
-					if (!cnt) mkcg_out_xpm(cg);
-					break;
+	if (!mkcg_pack(cg))
+		return PCMT_EXSTAT_NOMEM;
 
-				default:
-					exit(PCMT_EXSTAT_CRITERR);
-			}
-		}
+	return PCMT_EXSTAT_OK;
+}
 
-		for (cnt = 0; cnt < cg->number; cnt++) {
+static int _mkcg_execopt(mkcg_cg *cg)
+{
+	unsigned int	cnt;
+	int		status;
+	uint64_t	ts;
+	bool		ok;
 
-			XpmFreeXpmImage(&(cg->ch[cnt].image));
-			XpmFreeXpmInfo(&(cg->ch[cnt].info));
+	cg->options |= (cg->options & OPT_MKCG_ACTIONMASK) ? cg->options : OPT_MKCG_HEXDUMP;
 
-		}
+	/* a layout is an address formula of the hexdump only */
+	if (cg->opt_layout &&
+	    ((cg->options & OPT_MKCG_ACTIONMASK) != OPT_MKCG_HEXDUMP))
+		return PCMT_EXSTAT_WRONGOPT;
+
+	if (!cg->opt_files_number && !cg->opt_archive)
+		return PCMT_EXSTAT_NOFILES;
+
+	if ((cg->options & OPT_MKCG_ACTIONMASK) == OPT_MKCG_LINT) {
+		if (!cg->opt_files_number)
+			return PCMT_EXSTAT_NOFILES;
+		MKCG_TRACE_BEGIN(cg, lint, -1, ts);
+		status = mkcg_lint(cg, cg->opt_files_number, cg->opt_files) ?
+			PCMT_EXSTAT_OK : PCMT_EXSTAT_CONVERR;
+		MKCG_TRACE_END(cg, lint, -1, ts);
+		return status;
+	}
+
+	_mkcg_release(cg);
+
+	if (!cg->opt_archive && (cg->opt_files_number == 1) &&
+	    mkcg_container_probe(cg->opt_files[0])) {
+		MKCG_TRACE_BEGIN(cg, container, -1, ts);
+		ok = mkcg_container_read(cg, cg->opt_files[0]);
+		MKCG_TRACE_END(cg, container, -1, ts);
+		if (!ok)
+			return PCMT_EXSTAT_CONVERR;
+	} else if ((status = _mkcg_load_xpm(cg)) != PCMT_EXSTAT_OK)
+		return status;
+
+	MKCG_TRACE_BEGIN(cg, derive, -1, ts);
+	ok = mkcg_derive_banks(cg);
+	MKCG_TRACE_END(cg, derive, -1, ts);
+	if (!ok)
+		return PCMT_EXSTAT_CONVERR;
+
+	for (cnt = 0; cnt < cg->banks * cg->number; cnt++) {
+
+		if (cg->options & OPT_MKCG_VERBOSE)
+			INF("process: %s ... ", cg->ch[cnt % cg->number].filename);
+
+		switch (cg->options & OPT_MKCG_ACTIONMASK) {
+
+			case OPT_MKCG_HEXDUMP:
+				if (!cg->opt_layout) {
+					MKCG_TRACE_BEGIN(cg, hexdump, cnt, ts);
+					mkcg_out_xxd(cg, cnt,
+						cnt * cg->bound_bytes * cg->row_bytes);
+					MKCG_TRACE_END(cg, hexdump, cnt, ts);
+				} else if (!cnt) {
+					MKCG_TRACE_BEGIN(cg, layout, -1, ts);
+					ok = mkcg_out_layout(cg);
+					MKCG_TRACE_END(cg, layout, -1, ts);
+					if (!ok)
+						return PCMT_EXSTAT_CONVERR;
+				}
+				break;
 
-		exit(EXIT_SUCCESS);
+			case OPT_MKCG_BANNER:
+				MKCG_TRACE_BEGIN(cg, banner, cnt, ts);
+				mkcg_out_banner(cg, cnt);
+				MKCG_TRACE_END(cg, banner, cnt, ts);
+				break;
 
-	} else {
-		exit(PCMT_EXSTAT_NOFILES);
+			case OPT_MKCG_OVERVIEW:
+				if (!cnt) {
+					MKCG_TRACE_BEGIN(cg, overview, -1, ts);
+					ok = mkcg_out_xpm(cg);
+					MKCG_TRACE_END(cg, overview, -1, ts);
+					if (!ok)
+						return PCMT_EXSTAT_IOERR;
+				}
+				break;
+
+			case OPT_MKCG_SIMILAR:
+				if (!cnt) {
+					MKCG_TRACE_BEGIN(cg, similar, -1, ts);
+					ok = mkcg_similar(cg);
+					MKCG_TRACE_END(cg, similar, -1, ts);
+					if (!ok)
+						return PCMT_EXSTAT_NOMEM;
+				}
+				break;
+
+			case OPT_MKCG_CONTAINER:
+				if (!cnt) {
+					MKCG_TRACE_BEGIN(cg, store, -1, ts);
+					ok = mkcg_out_container(cg);
+					MKCG_TRACE_END(cg, store, -1, ts);
+					if (!ok)
+						return PCMT_EXSTAT_IOERR;
+				}
+				break;
+
+			case OPT_MKCG_RENDER:
+				if (!cg->opt_screen_number)
+					return PCMT_EXSTAT_NOFILES;
+				if (!cnt) {
+					MKCG_TRACE_BEGIN(cg, render, -1, ts);
+					ok = mkcg_out_screen(cg);
+					MKCG_TRACE_END(cg, render, -1, ts);
+					if (!ok)
+						return PCMT_EXSTAT_IOERR;
+				}
+				break;
+
+			default:
+				return PCMT_EXSTAT_CRITERR;
+		}
 	}
+
+	if (fflush(cg->out))
+		return PCMT_EXSTAT_IOERR;
+
+	return PCMT_EXSTAT_OK;
+}
+
+int mkcg_execopt(mkcg_cg *cg)
+{
+	int status;
+
+	cg->trace_number = cg->trace_lost = 0;
+	if (cg->opt_trace_file)
+		cg->trace_epoch = mkcg_trace_now();
+
+	status = _mkcg_execopt(cg);
+
+	/* the spans of a failed run are the interesting ones */
+	if (cg->opt_trace_file && !mkcg_trace_write(cg) &&
+	    (status == PCMT_EXSTAT_OK))
+		status = PCMT_EXSTAT_IOERR;
+
+	_mkcg_release(cg);
+
+	return status;
 }
@@ -30,31 +30,46 @@ further into srecord.\n"
 #define BOUND_BITS	8	/* !!! never less than EXP_WIDTH !!! */
 #define BOUND_BYTES	16
 
-#define EXP_WIDTH	8	/* !!! never more than 8 !!! */
+#define EXP_WIDTH	8	/* !!! never more than 32 !!! */
 #define EXP_HIGHT	10	/* !!! never more than BOUND_BYTES !!! */
 #define EXP_MAX_COLOR	2	/* !!! more than 2 colors are stupid, because
 				       only one dot color will be used !!! */
 #define EXP_DOT_COLOR	"#000000"
 
+#define ROM_CHARS	128	/* characters per bank in the PROM */
 
-mkcg_cg CG;
+#define SCREEN_COLS	80	/* characters per text row in video RAM */
+#define SCREEN_ROWS	24	/* text rows in video RAM */
 
 
 int main(int argc, char **argv)
 {
-	CG.progname	= argv[0];
-	CG.description	= DESCRIPTION;
+	mkcg_cg	cg;
+	int	status;
 
-	CG.options	= OPT_MKCG_NEGATED;
-	CG.ch		= (mkcg_ch *)NULL;
+	mkcg_init(&cg);
 
-	CG.bound_bits		= BOUND_BITS;
-	CG.bound_bytes		= BOUND_BYTES;
-	CG.exp_ch_width		= EXP_WIDTH;
-	CG.exp_ch_hight		= EXP_HIGHT;
-	CG.exp_ch_max_color	= EXP_MAX_COLOR;
-	CG.exp_ch_dot_color	= EXP_DOT_COLOR;
+	cg.progname	= argv[0];
+	cg.description	= DESCRIPTION;
 
-	mkcg_getopt(&CG, argc, argv);
-	mkcg_execopt(&CG, argc, argv);
+	cg.options	= OPT_MKCG_NEGATED;
+
+	cg.bound_bits		= BOUND_BITS;
+	cg.bound_bytes		= BOUND_BYTES;
+	cg.exp_ch_width		= EXP_WIDTH;
+	cg.exp_ch_hight		= EXP_HIGHT;
+	cg.exp_ch_max_color	= EXP_MAX_COLOR;
+	cg.exp_ch_dot_color	= EXP_DOT_COLOR;
+	cg.rom_chars		= ROM_CHARS;
+	cg.screen_cols		= SCREEN_COLS;
+	cg.screen_rows		= SCREEN_ROWS;
+
+	status = mkcg_getopt(&cg, argc, argv);
+	if (status == PCMT_EXSTAT_OK)
+		status = mkcg_execopt(&cg);
+
+	mkcg_report(&cg, status);
+	mkcg_free(&cg);
+
+	return status == PCMT_EXSTAT_DONE ? EXIT_SUCCESS : status;
 }
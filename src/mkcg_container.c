@@ -0,0 +1,541 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if HAVE_MMAP
+# include <sys/mman.h>
+# define CONTAINER_HEAP		false
+#else
+# define CONTAINER_HEAP		true	/* read into memory */
+#endif
+
+/*
+ * The glyph set container is the packed glyph table of a character set
+ * as a file, made to be mapped and used in place.  All numbers are
+ * little endian, every section starts 64-byte aligned:
+ *
+ *   header   magic, version, profile, glyph count and section offsets
+ *   index    one { code point, glyph, name offset } entry per glyph,
+ *            sorted by code point and glyph
+ *   names    the NUL terminated paths of the glyphs, in set order and
+ *            relative to the directory the whole set shares
+ *   rows     number * bound_bytes rows of row_bytes each, like cg->rows
+ *
+ * A glyph not named ascii_0xNN.xpm has the code point CONTAINER_NOCODE
+ * and sorts last.  Derived banks are not stored, they are derived again
+ * on load.  The major version changes with any incompatible layout, a
+ * reader takes any minor version and skips a longer header.
+ */
+#define CONTAINER_MAGIC		"MKCGSET\032"
+#define CONTAINER_MAJOR		3
+#define CONTAINER_MINOR		0
+#define CONTAINER_ALIGN		64
+#define CONTAINER_HEADER	64
+#define CONTAINER_ENTRY		12
+#define CONTAINER_NOCODE	0xFFFFFFFFUL
+
+#define ALIGN(X)	(((X) + CONTAINER_ALIGN - 1) & ~(uint64_t)(CONTAINER_ALIGN - 1))
+
+typedef struct {
+
+	uint32_t	code;
+	uint32_t	glyph;
+	uint32_t	name;
+
+} _mkcg_container_entry;
+
+static void _mkcg_container_put(unsigned char *buf, uint64_t value,
+		unsigned int bytes)
+{
+	unsigned int cnt;
+
+	for (cnt = 0; cnt < bytes; cnt++)
+		buf[cnt] = (value >> (8 * cnt)) & 0xFF;
+}
+
+static uint64_t _mkcg_container_get(const unsigned char *buf,
+		unsigned int bytes)
+{
+	uint64_t	value = 0;
+	unsigned int	cnt;
+
+	for (cnt = bytes; cnt > 0; cnt--)
+		value = (value << 8) | buf[cnt - 1];
+
+	return value;
+}
+
+/* Row ROW of a glyph whose rows start at PACKED in a container. */
+uint32_t mkcg_container_row(mkcg_cg *cg, const unsigned char *packed,
+		unsigned int row)
+{
+	return _mkcg_container_get(packed + row * cg->row_bytes, cg->row_bytes);
+}
+
+static bool _mkcg_container_pad(mkcg_cg *cg, uint64_t *pos)
+{
+	static const unsigned char zero[CONTAINER_ALIGN];
+	size_t len = ALIGN(*pos) - *pos;
+
+	*pos += len;
+	return fwrite(zero, 1, len, cg->out) == len;
+}
+
+static int _mkcg_container_cmp(const void *a, const void *b)
+{
+	const _mkcg_container_entry *ea = (const _mkcg_container_entry *)a;
+	const _mkcg_container_entry *eb = (const _mkcg_container_entry *)b;
+
+	if (ea->code != eb->code)
+		return ea->code < eb->code ? -1 : 1;
+	return ea->glyph < eb->glyph ? -1 : ea->glyph > eb->glyph;
+}
+
+/* Length of the directory part all file names of the set start with. */
+static size_t _mkcg_container_base(mkcg_cg *cg)
+{
+	const char	*first = cg->ch[0].filename;
+	size_t		len = strlen(first), cnt, pos;
+
+	for (cnt = 1; cnt < cg->number; cnt++)
+		for (pos = 0; pos < len; pos++)
+			if (cg->ch[cnt].filename[pos] != first[pos]) {
+				len = pos;
+				break;
+			}
+
+	while (len && (first[len - 1] != '/'))
+		len--;
+
+	return len;
+}
+
+/* Write bank 0 of the loaded set as container to the output stream. */
+bool mkcg_out_container(mkcg_cg *cg)
+{
+	unsigned char		head[CONTAINER_HEADER], buf[CONTAINER_ENTRY];
+	unsigned char		*rows = (unsigned char *)NULL;
+	_mkcg_container_entry	*entry;
+	unsigned long		code;
+	uint64_t		pos, names_size;
+	size_t			cnt, cnt_h, base;
+	unsigned int		size;
+	bool			ret;
+
+	if (!cg->number ||
+	    !(entry = (_mkcg_container_entry *)malloc(cg->number
+			* sizeof(_mkcg_container_entry))))
+		return false;
+
+	base = _mkcg_container_base(cg);
+	for (cnt = names_size = 0; cnt < cg->number; cnt++) {
+		code = mkcg_archive_code(cg->ch[cnt].filename);
+		entry[cnt].code  = code < CONTAINER_NOCODE ? code : CONTAINER_NOCODE;
+		entry[cnt].glyph = cnt;
+		entry[cnt].name  = names_size;
+		names_size += strlen(cg->ch[cnt].filename + base) + 1;
+	}
+	qsort(entry, cg->number, sizeof(_mkcg_container_entry),
+			_mkcg_container_cmp);
+
+	memset((void *)head, 0, sizeof(head));
+	memcpy(head, CONTAINER_MAGIC, 8);
+	_mkcg_container_put(&head[8], CONTAINER_MAJOR, 2);
+	_mkcg_container_put(&head[10], CONTAINER_MINOR, 2);
+	_mkcg_container_put(&head[12], CONTAINER_HEADER, 4);
+	_mkcg_container_put(&head[16], cg->bound_bits, 4);
+	_mkcg_container_put(&head[20], cg->bound_bytes, 4);
+	_mkcg_container_put(&head[24], cg->exp_ch_width, 4);
+	_mkcg_container_put(&head[28], cg->exp_ch_hight, 4);
+	_mkcg_container_put(&head[32], cg->row_bytes, 4);
+	_mkcg_container_put(&head[36], cg->number, 4);
+	pos = CONTAINER_HEADER;
+	_mkcg_container_put(&head[40], pos = ALIGN(pos), 8);
+	_mkcg_container_put(&head[48],
+			pos = ALIGN(pos + cg->number * CONTAINER_ENTRY), 8);
+	_mkcg_container_put(&head[56], pos = ALIGN(pos + names_size), 8);
+
+	/* name offsets are 32 bits wide */
+	ret = (names_size <= 0xFFFFFFFFULL) &&
+		(fwrite(head, 1, sizeof(head), cg->out) == sizeof(head));
+
+	pos = sizeof(head);
+	ret = ret && _mkcg_container_pad(cg, &pos);
+
+	for (cnt = 0; ret && cnt < cg->number; cnt++) {
+		_mkcg_container_put(&buf[0], entry[cnt].code, 4);
+		_mkcg_container_put(&buf[4], entry[cnt].glyph, 4);
+		_mkcg_container_put(&buf[8], entry[cnt].name, 4);
+		ret = fwrite(buf, 1, sizeof(buf), cg->out) == sizeof(buf);
+		pos += sizeof(buf);
+	}
+	ret = ret && _mkcg_container_pad(cg, &pos);
+
+	for (cnt = 0; ret && cnt < cg->number; cnt++) {
+		size = strlen(cg->ch[cnt].filename + base) + 1;
+		ret = fwrite(cg->ch[cnt].filename + base, 1, size, cg->out) == size;
+		pos += size;
+	}
+	ret = ret && _mkcg_container_pad(cg, &pos);
+
+	if (ret && !(rows = (unsigned char *)malloc(cg->bound_bytes * cg->row_bytes)))
+		ret = false;
+
+	for (cnt = 0; ret && cnt < cg->number; cnt++) {
+		for (cnt_h = 0; cnt_h < cg->bound_bytes; cnt_h++)
+			_mkcg_container_put(&rows[cnt_h * cg->row_bytes],
+					mkcg_row_get(cg, cnt * cg->bound_bytes + cnt_h),
+					cg->row_bytes);
+		size = cg->bound_bytes * cg->row_bytes;
+		ret = fwrite(rows, 1, size, cg->out) == size;
+	}
+
+	if (rows)
+		free(rows);
+	free(entry);
+
+	return ret && !fflush(cg->out);
+}
+
+/* True if the file starts with the container magic. */
+bool mkcg_container_probe(const char *path)
+{
+	char	magic[8];
+	bool	ret;
+	int	fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+
+	ret = (pread(fd, magic, sizeof(magic), 0) == sizeof(magic)) &&
+		!memcmp(magic, CONTAINER_MAGIC, sizeof(magic));
+	close(fd);
+
+	return ret;
+}
+
+#define CONTAINER_FAIL(CG,PATH,REASON) do { \
+		if (!((CG)->options & OPT_MKCG_QUIET)) \
+			ERR("container: %s: %s", PATH, REASON); \
+		return false; \
+	} while (0)
+
+/* Map the whole file, or read it where there is no mmap(2). */
+static unsigned char *_mkcg_container_load(int fd, size_t size)
+{
+	unsigned char	*addr;
+#if HAVE_MMAP
+
+	addr = (unsigned char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	return addr == MAP_FAILED ? (unsigned char *)NULL : addr;
+#else
+	ssize_t		got;
+	size_t		pos;
+
+	if (!(addr = (unsigned char *)malloc(size)))
+		return (unsigned char *)NULL;
+
+	for (pos = 0; pos < size; pos += got) {
+		got = pread(fd, addr + pos, size - pos, pos);
+		if ((got < 0) && (errno == EINTR)) {
+			got = 0;
+			continue;
+		}
+		if (got <= 0) {
+			free(addr);
+			return (unsigned char *)NULL;
+		}
+	}
+
+	return addr;
+#endif
+}
+
+/* Release a container loaded by _mkcg_container_load() or read. */
+static void _mkcg_container_unload(unsigned char *addr, size_t size,
+		bool heap)
+{
+#if HAVE_MMAP
+	if (!heap) {
+		munmap(addr, size);
+		return;
+	}
+#endif
+	free(addr);
+}
+
+/*
+ * Check the index: every glyph exactly once, sorted by code point and
+ * glyph, each name a string inside the names section.  NULL if fine,
+ * else the reason.
+ */
+static const char *_mkcg_container_index(const unsigned char *addr,
+		uint64_t number, uint64_t index, uint64_t names, uint64_t rows)
+{
+	const unsigned char	*entry;
+	const char		*reason = (const char *)NULL;
+	unsigned char		*seen;
+	uint64_t		code, glyph, name, last_code = 0, last_glyph = 0;
+	size_t			cnt;
+
+	if (!(seen = (unsigned char *)calloc(number, 1)))
+		return "no memory";
+
+	for (cnt = 0; !reason && (cnt < number); cnt++) {
+		entry	= &addr[index + cnt * CONTAINER_ENTRY];
+		code	= _mkcg_container_get(&entry[0], 4);
+		glyph	= _mkcg_container_get(&entry[4], 4);
+		name	= _mkcg_container_get(&entry[8], 4);
+
+		if ((glyph >= number) || seen[glyph] || (cnt &&
+		    ((code < last_code) ||
+		     ((code == last_code) && (glyph < last_glyph)))))
+			reason = "broken index";
+		else if ((name >= rows - names) ||
+		    !memchr(addr + names + name, '\0', rows - names - name))
+			reason = "broken name table";
+		else
+			seen[glyph] = 1;
+
+		last_code	= code;
+		last_glyph	= glyph;
+	}
+
+	free(seen);
+
+	return reason;
+}
+
+/*
+ * Check a container against the profile of the context.  Everything a
+ * reader touches later is checked here, the section offsets are taken
+ * apart by subtraction so no sum can wrap.
+ */
+static bool _mkcg_container_check(mkcg_cg *cg, const char *path,
+		const mkcg_map *map)
+{
+	const unsigned char	*addr = map->addr;
+	const char		*reason;
+	uint64_t		number, index, names, rows;
+
+	if ((map->size < CONTAINER_HEADER) ||
+	    memcmp(addr, CONTAINER_MAGIC, 8) ||
+	    (_mkcg_container_get(&addr[8], 2) != CONTAINER_MAJOR) ||
+	    (_mkcg_container_get(&addr[12], 4) < CONTAINER_HEADER))
+		CONTAINER_FAIL(cg, path, "unknown format or version");
+
+	if ((_mkcg_container_get(&addr[16], 4) != cg->bound_bits) ||
+	    (_mkcg_container_get(&addr[20], 4) != cg->bound_bytes) ||
+	    (_mkcg_container_get(&addr[24], 4) != cg->exp_ch_width) ||
+	    (_mkcg_container_get(&addr[28], 4) != cg->exp_ch_hight) ||
+	    (_mkcg_container_get(&addr[32], 4) != cg->row_bytes))
+		CONTAINER_FAIL(cg, path, "made for another character generator");
+
+	number	= _mkcg_container_get(&addr[36], 4);
+	index	= _mkcg_container_get(&addr[40], 8);
+	names	= _mkcg_container_get(&addr[48], 8);
+	rows	= _mkcg_container_get(&addr[56], 8);
+
+	if (!number || (rows % CONTAINER_ALIGN) ||
+	    (index < CONTAINER_HEADER) || (index > names) ||
+	    (names > rows) || (rows > map->size) ||
+	    ((names - index) / CONTAINER_ENTRY < number) ||
+	    ((map->size - rows) / (cg->bound_bytes * cg->row_bytes) < number))
+		CONTAINER_FAIL(cg, path, "broken section table");
+
+	if ((reason = _mkcg_container_index(addr, number, index, names, rows)))
+		CONTAINER_FAIL(cg, path, reason);
+
+	return true;
+}
+
+/*
+ * Add a loaded container to the maps of the context, HEAP if it was
+ * read into memory.  The release frees or unmaps it.
+ */
+static bool _mkcg_container_add(mkcg_cg *cg, unsigned char *addr,
+		size_t size, bool heap)
+{
+	mkcg_map	*map;
+
+	if (!(map = (mkcg_map *)realloc(cg->map,
+			(cg->map_number + 1) * sizeof(mkcg_map))))
+		return false;
+
+	cg->map = map;
+	map = &cg->map[cg->map_number++];
+	map->addr	= addr;
+	map->size	= size;
+	map->heap	= heap;
+
+	return true;
+}
+
+/* Map a container file and check it, the map is the last one. */
+static bool _mkcg_container_map(mkcg_cg *cg, const char *path)
+{
+	unsigned char	*addr;
+	struct stat	st;
+	int		fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		CONTAINER_FAIL(cg, path, "can not open file");
+
+	if (fstat(fd, &st) || (st.st_size < CONTAINER_HEADER)) {
+		close(fd);
+		CONTAINER_FAIL(cg, path, "can not read file");
+	}
+
+	addr = _mkcg_container_load(fd, st.st_size);
+	close(fd);
+	if (!addr)
+		CONTAINER_FAIL(cg, path, "can not map file");
+
+	if (!_mkcg_container_add(cg, addr, st.st_size, CONTAINER_HEAP)) {
+		_mkcg_container_unload(addr, st.st_size, CONTAINER_HEAP);
+		return false;
+	}
+
+	return _mkcg_container_check(cg, path, &cg->map[cg->map_number - 1]);
+}
+
+/* Fill CH with the glyphs of a checked container map. */
+static size_t _mkcg_container_glyphs(mkcg_cg *cg, const mkcg_map *map,
+		mkcg_ch *ch)
+{
+	unsigned char	*addr = map->addr, *entry;
+	uint64_t	index, names, rows;
+	size_t		number, cnt, glyph;
+
+	number	= _mkcg_container_get(&addr[36], 4);
+	index	= _mkcg_container_get(&addr[40], 8);
+	names	= _mkcg_container_get(&addr[48], 8);
+	rows	= _mkcg_container_get(&addr[56], 8);
+
+	/* the index names every glyph once, put each in its set place */
+	for (cnt = 0; ch && (cnt < number); cnt++) {
+		entry = &addr[index + cnt * CONTAINER_ENTRY];
+		glyph = _mkcg_container_get(&entry[4], 4);
+		ch[glyph].filename = (char *)addr + names
+				+ _mkcg_container_get(&entry[8], 4);
+		ch[glyph].packed = addr + rows
+				+ glyph * cg->bound_bytes * cg->row_bytes;
+	}
+
+	return number;
+}
+
+/*
+ * Take a container as the loaded set.  Without banks to derive (they
+ * need room behind bank 0) and unless the host is big endian the rows
+ * are used in place, straight out of the mapping.
+ */
+bool mkcg_container_read(mkcg_cg *cg, const char *path)
+{
+	static const uint16_t	little = 1;
+	mkcg_map		*map;
+
+	cg->row_bytes = cg->bound_bits > 16 ? 4 : cg->bound_bits > 8 ? 2 : 1;
+
+	if (!_mkcg_container_map(cg, path))
+		return false;
+
+	map = &cg->map[cg->map_number - 1];
+	cg->number = _mkcg_container_glyphs(cg, map, (mkcg_ch *)NULL);
+	if (!(cg->ch = (mkcg_ch *)calloc(cg->number, sizeof(mkcg_ch))))
+		return false;
+	_mkcg_container_glyphs(cg, map, cg->ch);
+
+	if (!cg->opt_derive_number &&
+	    ((cg->row_bytes == 1) || *(const uint8_t *)&little)) {
+		cg->banks = 1;
+		cg->rows = cg->ch[0].packed;
+		cg->map_rows = true;
+		return true;
+	}
+
+	return mkcg_pack(cg);
+}
+
+/* True if the head of a read file is the container magic. */
+bool mkcg_container_head(const char *head, size_t size)
+{
+	return (size >= 8) && !memcmp(head, CONTAINER_MAGIC, 8);
+}
+
+/*
+ * Append the glyphs of a container to the set, in its place among the
+ * XPMFILEs, so both can be given in any mix and order.  FILE is the
+ * container as read already, its buffer is taken over, so the file is
+ * not opened a second time.  ROOM is the number of glyphs still to
+ * follow it.
+ */
+bool mkcg_container_append(mkcg_cg *cg, mkcg_ch *file, size_t room)
+{
+	mkcg_ch		*ch;
+	size_t		number;
+
+	cg->row_bytes = cg->bound_bits > 16 ? 4 : cg->bound_bits > 8 ? 2 : 1;
+
+	if (!_mkcg_container_add(cg, (unsigned char *)file->buffer,
+			file->size, true))
+		return false;
+
+	/* the map owns the buffer now, also if the check fails */
+	file->buffer = (char *)NULL;
+
+	if (!_mkcg_container_check(cg, file->filename,
+			&cg->map[cg->map_number - 1]))
+		return false;
+
+	number = _mkcg_container_glyphs(cg, &cg->map[cg->map_number - 1],
+			(mkcg_ch *)NULL);
+	if (!(ch = (mkcg_ch *)realloc(cg->ch,
+			(cg->number + number + room) * sizeof(mkcg_ch))))
+		return false;
+
+	cg->ch = ch;
+	memset((void *)&ch[cg->number], 0, number * sizeof(mkcg_ch));
+	cg->number += _mkcg_container_glyphs(cg, &cg->map[cg->map_number - 1],
+			&ch[cg->number]);
+
+	return true;
+}
+
+void mkcg_container_close(mkcg_cg *cg)
+{
+	size_t cnt;
+
+	for (cnt = 0; cnt < cg->map_number; cnt++)
+		_mkcg_container_unload(cg->map[cnt].addr, cg->map[cnt].size,
+				cg->map[cnt].heap);
+
+	if (cg->map)
+		free(cg->map);
+
+	cg->map		= (mkcg_map *)NULL;
+	cg->map_number	= 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+enum {
+	DERIVE_NEG = 0,
+	DERIVE_UL,
+	DERIVE_BOLD,
+	DERIVE_MIRROR,
+	DERIVE_DHTOP,
+	DERIVE_DHBOTTOM,
+};
+
+static char *const _mkcg_derive_tokens[] = {
+	[DERIVE_NEG]		= "neg",
+	[DERIVE_UL]		= "ul",
+	[DERIVE_BOLD]		= "bold",
+	[DERIVE_MIRROR]		= "mirror",
+	[DERIVE_DHTOP]		= "dhtop",
+	[DERIVE_DHBOTTOM]	= "dhbottom",
+	NULL
+};
+
+/* Parse one --derive=OP[,OP]... bank specification. */
+bool mkcg_derive_parse(mkcg_cg *cg, char *spec)
+{
+	mkcg_derive	*derive;
+	char		*value, *end;
+	unsigned long	row;
+	int		token;
+
+	derive = (mkcg_derive *)realloc(cg->opt_derive,
+			(cg->opt_derive_number + 1) * sizeof(mkcg_derive));
+	if (!derive)
+		return false;
+
+	cg->opt_derive = derive;
+	derive = &cg->opt_derive[cg->opt_derive_number++];
+	derive->ops	= 0;
+	derive->ul_row	= MKCG_DERIVE_ULROW_LAST;
+
+	while (*spec != '\0') {
+
+		token = getsubopt(&spec, _mkcg_derive_tokens, &value);
+
+		/* only ul takes a value, a row number */
+		if (value && (token != DERIVE_UL))
+			return false;
+
+		switch (token) {
+
+			case DERIVE_NEG:
+				derive->ops |= MKCG_DERIVE_NEGATE;
+				break;
+
+			case DERIVE_UL:
+				derive->ops |= MKCG_DERIVE_UNDERLINE;
+				if (!value)
+					break;
+				if (!isdigit(value[0]))
+					return false;
+				row = strtoul(value, &end, 10);
+				if (*end || (row >= MKCG_DERIVE_ULROW_LAST))
+					return false;
+				derive->ul_row = row;
+				break;
+
+			case DERIVE_BOLD:
+				derive->ops |= MKCG_DERIVE_BOLD;
+				break;
+
+			case DERIVE_MIRROR:
+				derive->ops |= MKCG_DERIVE_MIRROR;
+				break;
+
+			case DERIVE_DHTOP:
+				derive->ops |= MKCG_DERIVE_DHTOP;
+				break;
+
+			case DERIVE_DHBOTTOM:
+				derive->ops |= MKCG_DERIVE_DHBOTTOM;
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	return (derive->ops & (MKCG_DERIVE_DHTOP | MKCG_DERIVE_DHBOTTOM))
+		!= (MKCG_DERIVE_DHTOP | MKCG_DERIVE_DHBOTTOM);
+}
+
+static inline uint32_t _mkcg_derive_reverse(uint32_t bits)
+{
+	bits = ((bits & 0xFFFF0000) >> 16) | ((bits & 0x0000FFFF) << 16);
+	bits = ((bits & 0xFF00FF00) >> 8) | ((bits & 0x00FF00FF) << 8);
+	bits = ((bits & 0xF0F0F0F0) >> 4) | ((bits & 0x0F0F0F0F) << 4);
+	bits = ((bits & 0xCCCCCCCC) >> 2) | ((bits & 0x33333333) << 2);
+	bits = ((bits & 0xAAAAAAAA) >> 1) | ((bits & 0x55555555) << 1);
+	return bits;
+}
+
+/* source scanline per target scanline, out of range is blank (~0) */
+static void _mkcg_derive_rowmap(mkcg_cg *cg, mkcg_derive *derive,
+		unsigned int *rowmap)
+{
+	unsigned int	cnt_h, map;
+	unsigned int	half = (cg->exp_ch_hight + 1) / 2;
+
+	for (cnt_h = 0; cnt_h < cg->bound_bytes; cnt_h++) {
+		if (derive->ops & MKCG_DERIVE_DHTOP)
+			map = cnt_h < cg->exp_ch_hight ? cnt_h / 2 : cg->bound_bytes;
+		else if (derive->ops & MKCG_DERIVE_DHBOTTOM)
+			map = cnt_h < cg->exp_ch_hight ? half + cnt_h / 2 : cg->bound_bytes;
+		else
+			map = cnt_h;
+		rowmap[cnt_h] = map < cg->exp_ch_hight ? map : ~0U;
+	}
+}
+
+/*
+ * All transformations of one bank are folded into bank invariant masks
+ * and a scanline map, so every derived bank is produced in one single
+ * branch free pass over the packed base bank, specialised by row type.
+ */
+#define MKCG_DERIVE_BANK(BITS) \
+static void _mkcg_derive_bank_##BITS(mkcg_cg *cg, mkcg_derive *derive, \
+		unsigned int *rowmap, uint##BITS##_t *dst) \
+{ \
+	unsigned int	cnt, cnt_h; \
+	uint##BITS##_t	v, m; \
+	const uint##BITS##_t *src	= (const uint##BITS##_t *)cg->rows; \
+	unsigned int	width		= cg->exp_ch_width; \
+	uint##BITS##_t	full		= MKCG_ROW_MASK(width); \
+	uint##BITS##_t	neg_mask	= derive->ops & MKCG_DERIVE_NEGATE ? \
+						MKCG_ROW_MASK(cg->bound_bits) : 0; \
+	uint##BITS##_t	bold_mask	= derive->ops & MKCG_DERIVE_BOLD ? full : 0; \
+	uint##BITS##_t	mirror_mask	= derive->ops & MKCG_DERIVE_MIRROR ? full : 0; \
+	unsigned int	ul_row		= !(derive->ops & MKCG_DERIVE_UNDERLINE) ? \
+						cg->bound_bytes : \
+					  derive->ul_row == MKCG_DERIVE_ULROW_LAST ? \
+						cg->exp_ch_hight - 1 : derive->ul_row; \
+\
+	for (cnt = 0; cnt < cg->number; cnt++) { \
+\
+		for (cnt_h = 0; cnt_h < cg->bound_bytes; cnt_h++) { \
+\
+			v = rowmap[cnt_h] == ~0U ? 0 : src[rowmap[cnt_h]]; \
+\
+			m = _mkcg_derive_reverse(v) >> (32 - width); \
+			v = (v & ~mirror_mask) | (m & mirror_mask); \
+			v |= (v >> 1) & bold_mask; \
+			v = cnt_h == ul_row ? full : v; \
+			dst[cnt_h] = v ^ neg_mask; \
+\
+		} \
+\
+		src += cg->bound_bytes; \
+		dst += cg->bound_bytes; \
+	} \
+}
+
+MKCG_DERIVE_BANK(8)
+MKCG_DERIVE_BANK(16)
+MKCG_DERIVE_BANK(32)
+
+bool mkcg_derive_banks(mkcg_cg *cg)
+{
+	unsigned int	rowmap[cg->bound_bytes];
+	size_t		cnt, offset;
+
+	/* the glyph size may be set after --derive, check the row here */
+	for (cnt = 0; cnt < cg->opt_derive_number; cnt++) {
+		if ((cg->opt_derive[cnt].ul_row != MKCG_DERIVE_ULROW_LAST) &&
+		    (cg->opt_derive[cnt].ul_row >= cg->bound_bytes)) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("derive: underline row %u out of %u rows",
+						cg->opt_derive[cnt].ul_row,
+						cg->bound_bytes);
+			return false;
+		}
+	}
+
+	for (cnt = 0; cnt < cg->opt_derive_number; cnt++) {
+
+		if (cg->options & OPT_MKCG_VERBOSE)
+			INF("derive: bank %zu ops 0x%02X ... ",
+					cnt + 1, cg->opt_derive[cnt].ops);
+
+		_mkcg_derive_rowmap(cg, &cg->opt_derive[cnt], rowmap);
+
+		offset = (cnt + 1) * cg->number * cg->bound_bytes;
+		MKCG_ROW_DISPATCH(cg, _mkcg_derive_bank, cg, &cg->opt_derive[cnt],
+				rowmap, (void *)((char *)cg->rows + offset * cg->row_bytes));
+	}
+
+	return true;
+}
@@ -0,0 +1,297 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if HAVE_LIBURING
+# include <liburing.h>
+#endif
+
+/*
+ * Read the glyph files of the set batch by batch and hand every batch
+ * to the caller, who parses it, before the next one is queued, so only
+ * one batch of files is held in memory at a time.  With liburing the
+ * opens, reads and closes of a batch go to the kernel in one submission
+ * each, otherwise, or if the kernel refuses io_uring, a plain pread
+ * loop is used.  Glyph files are small, the first read of IO_HEAD_SIZE
+ * bytes usually covers the whole file, its buffer takes just its size.
+ */
+#define IO_BATCH	64
+#define IO_HEAD_SIZE	4096
+#define IO_RETRY	8
+
+/*
+ * A container ahead of a file moves it in the set, so the span of a
+ * read is kept with the file and traced by the caller, who knows its
+ * place.  The probes carry the position in the file list.
+ */
+#define IO_READ_BEGIN(CG,CH,FILE) do { \
+		MKCG_PROBE(read_begin, (long)(FILE)); \
+		(CH)->read_begin = (CG)->opt_trace_file ? mkcg_trace_now() : 0; \
+	} while (0)
+
+#define IO_READ_END(CG,CH,FILE) do { \
+		MKCG_PROBE(read_end, (long)(FILE)); \
+		(CH)->read_end = (CG)->opt_trace_file ? mkcg_trace_now() : 0; \
+	} while (0)
+
+/*
+ * Read an open file into a buffer of its size, the LEN bytes at HEAD
+ * are the start of it, read already.
+ */
+static bool _mkcg_io_fill(mkcg_ch *ch, int fd, const char *head, size_t len)
+{
+	struct stat	st;
+	size_t		size;
+	ssize_t		got;
+
+	if (fstat(fd, &st))
+		return false;
+
+	size = (size_t)st.st_size > len ? (size_t)st.st_size : len;
+	if (!(ch->buffer = (char *)malloc(size + 1)))
+		return false;
+
+	if (len)
+		memcpy(ch->buffer, head, len);
+	ch->size = len;
+
+	while (ch->size < size) {
+		got = pread(fd, ch->buffer + ch->size,
+				size - ch->size, ch->size);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		ch->size += got;
+	}
+
+	ch->buffer[ch->size] = '\0';
+	return true;
+}
+
+static bool _mkcg_io_read_plain(mkcg_ch *ch)
+{
+	bool	ret;
+	int	fd;
+
+	if ((fd = open(ch->filename, O_RDONLY)) < 0)
+		return false;
+
+	ret = _mkcg_io_fill(ch, fd, (const char *)NULL, 0);
+	close(fd);
+
+	return ret;
+}
+
+#if HAVE_LIBURING
+/*
+ * Wait for COUNT completions.  If waiting fails, the ring is given up
+ * for the rest of the set, but the completions of this submission are
+ * still collected, a few more tries, so no opened file gets lost and
+ * no read lands in a buffer already gone.  The slots not reaped keep
+ * their -ECANCELED.
+ */
+static bool _mkcg_io_reap(struct io_uring *ring, unsigned int count,
+		int *res)
+{
+	struct io_uring_cqe	*cqe = NULL;
+	unsigned int		cnt, retry = 0;
+	int			err;
+
+	for (cnt = 0; (cnt < count) && (retry < IO_RETRY); ) {
+		while ((err = io_uring_wait_cqe(ring, &cqe)) == -EINTR);
+		if (err) {
+			retry++;
+			continue;
+		}
+		res[cqe->user_data] = cqe->res;
+		io_uring_cqe_seen(ring, cqe);
+		cnt++;
+	}
+
+	return !retry;
+}
+
+static bool _mkcg_io_batch(mkcg_cg *cg, struct io_uring *ring,
+		char *scratch, mkcg_ch *ch, size_t first, unsigned int count,
+		bool *uring)
+{
+	struct io_uring_sqe	*sqe;
+	unsigned int		cnt, inflight;
+	int			fd[IO_BATCH], res[IO_BATCH];
+	char			*head;
+	bool			ret = true;
+
+	/* all reads of a batch are in flight together */
+	for (cnt = 0; cnt < count; cnt++)
+		IO_READ_BEGIN(cg, &ch[cnt], first + cnt);
+
+	for (cnt = 0; cnt < count; cnt++) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_openat(sqe, AT_FDCWD, ch[cnt].filename, O_RDONLY, 0);
+		sqe->user_data = cnt;
+		res[cnt] = -ECANCELED;
+	}
+	io_uring_submit(ring);
+	*uring = _mkcg_io_reap(ring, count, res);
+
+	for (cnt = inflight = 0; cnt < count; cnt++) {
+		fd[cnt] = res[cnt];
+		res[cnt] = -ECANCELED;
+		if ((fd[cnt] < 0) || !*uring)
+			continue;
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_read(sqe, fd[cnt], scratch + cnt * IO_HEAD_SIZE,
+				IO_HEAD_SIZE, 0);
+		sqe->user_data = cnt;
+		inflight++;
+	}
+	if (inflight) {
+		io_uring_submit(ring);
+		*uring = _mkcg_io_reap(ring, inflight, res);
+	}
+
+	/* every open file gets closed, even after a failed read */
+	for (cnt = inflight = 0; cnt < count; cnt++) {
+
+		head = scratch + cnt * IO_HEAD_SIZE;
+
+		if (fd[cnt] < 0) {
+			/* an old kernel without IORING_OP_OPENAT lands here */
+			if (ret && !_mkcg_io_read_plain(&ch[cnt]))
+				ret = false;
+			IO_READ_END(cg, &ch[cnt], first + cnt);
+			continue;
+		}
+
+		if (ret && (res[cnt] >= 0) && (res[cnt] < IO_HEAD_SIZE)) {
+			/* a short read is the whole file */
+			ch[cnt].size = res[cnt];
+			if ((ch[cnt].buffer = (char *)malloc(ch[cnt].size + 1))) {
+				memcpy(ch[cnt].buffer, head, ch[cnt].size);
+				ch[cnt].buffer[ch[cnt].size] = '\0';
+			} else
+				ret = false;
+		} else if (ret)
+			ret = _mkcg_io_fill(&ch[cnt], fd[cnt], head,
+					res[cnt] > 0 ? res[cnt] : 0);
+		IO_READ_END(cg, &ch[cnt], first + cnt);
+
+		if (!*uring) {
+			close(fd[cnt]);
+			continue;
+		}
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_close(sqe, fd[cnt]);
+		sqe->user_data = cnt;
+		inflight++;
+	}
+	if (inflight) {
+		io_uring_submit(ring);
+		*uring = _mkcg_io_reap(ring, inflight, res);
+	}
+
+	return ret;
+}
+#endif
+
+/*
+ * Read the NUMBER FILES batch by batch and call DONE with every batch,
+ * in order.  DONE may take a buffer over by setting it to NULL, all
+ * others are freed when it returns, and traces the read spans.  The
+ * status is that of DONE, or PCMT_EXSTAT_XPM_OF if a file can not be
+ * read, the reads of that batch are traced without a place in the set.
+ */
+int mkcg_io_readall(mkcg_cg *cg, char **files, size_t number,
+		mkcg_io_done done, void *arg)
+{
+	mkcg_ch		batch[IO_BATCH];
+	size_t		first;
+	unsigned int	count, cnt;
+	int		status = PCMT_EXSTAT_OK;
+	bool		ok;
+#if HAVE_LIBURING
+	struct io_uring	ring;
+	char		*scratch = (char *)NULL;
+	bool		uring, queue;
+
+	/* the heads of one batch, reused by all */
+	queue = uring = io_uring_queue_init(IO_BATCH, &ring, 0) == 0;
+	if (uring && !(scratch = (char *)malloc(IO_BATCH * IO_HEAD_SIZE)))
+		uring = false;
+
+	if (cg->options & OPT_MKCG_VERBOSE)
+		INF("read: %zu files by %s ... ", number,
+				uring ? "io_uring" : "pread");
+#else
+	if (cg->options & OPT_MKCG_VERBOSE)
+		INF("read: %zu files by %s ... ", number, "pread");
+#endif
+
+	for (first = 0; (status == PCMT_EXSTAT_OK) && (first < number);
+			first += count) {
+
+		count = number - first > IO_BATCH ? IO_BATCH : number - first;
+
+		memset((void *)batch, 0, count * sizeof(mkcg_ch));
+		for (cnt = 0; cnt < count; cnt++)
+			batch[cnt].filename = files[first + cnt];
+
+		ok = true;
+#if HAVE_LIBURING
+		/* a failed ring leaves the rest of the set to pread */
+		if (uring)
+			ok = _mkcg_io_batch(cg, &ring, scratch, batch, first,
+					count, &uring);
+		else
+#endif
+		for (cnt = 0; ok && (cnt < count); cnt++) {
+			IO_READ_BEGIN(cg, &batch[cnt], first + cnt);
+			ok = _mkcg_io_read_plain(&batch[cnt]);
+			IO_READ_END(cg, &batch[cnt], first + cnt);
+		}
+
+		status = ok ? done(cg, batch, count, arg) : PCMT_EXSTAT_XPM_OF;
+
+		for (cnt = 0; !ok && cg->opt_trace_file && (cnt < count); cnt++)
+			if (batch[cnt].read_end)
+				mkcg_trace_span(cg, "read", -1, batch[cnt].filename,
+						batch[cnt].read_begin,
+						batch[cnt].read_end);
+
+		for (cnt = 0; cnt < count; cnt++)
+			if (batch[cnt].buffer)
+				free(batch[cnt].buffer);
+	}
+
+#if HAVE_LIBURING
+	if (queue)
+		io_uring_queue_exit(&ring);
+	if (scratch)
+		free(scratch);
+#endif
+
+	return status;
+}
@@ -0,0 +1,345 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+/*
+ * A layout is an address formula for the ROM image.  It is a list of
+ * fields from the most significant address bit down, each one taking
+ * the next low order bits of a glyph coordinate: the character within
+ * its bank, the bank, the scanline and the byte within a wide row.  A
+ * coordinate may appear more than once to interleave its bits, e.g.
+ * "char:4,row:4,char:3" puts the three low character bits below the
+ * scanline.  A leading "select:BITS" splits the image over several
+ * EPROMs, the top BITS address bits pick the chip and every chip gets
+ * a dump of its own.
+ */
+#define LAYOUT_MAX_BITS	24
+#define LAYOUT_BLOCK	64
+
+static char *const _mkcg_layout_fields[MKCG_LAYOUT_FIELDS] = {
+	[MKCG_LAYOUT_CHAR]	= "char",
+	[MKCG_LAYOUT_BANK]	= "bank",
+	[MKCG_LAYOUT_ROW]	= "row",
+	[MKCG_LAYOUT_BYTE]	= "byte",
+};
+
+/* Address bits of a piece, 0 unless 1 up to LAYOUT_MAX_BITS.  */
+static unsigned int _mkcg_layout_bits(const char *spec, char **end)
+{
+	unsigned long bits;
+
+	if (!isdigit(spec[0]))
+		return 0;
+
+	bits = strtoul(spec, end, 10);
+	return bits <= LAYOUT_MAX_BITS ? bits : 0;
+}
+
+/*
+ * Parse the --layout=[select:BITS,]glyph|scanline|FIELD:BITS[,...]
+ * formula.
+ */
+bool mkcg_layout_parse(mkcg_cg *cg, char *spec)
+{
+	mkcg_layout	*layout;
+	unsigned int	field;
+	char		*token, *bits, *save, *end;
+
+	if (!cg->opt_layout &&
+	    !(cg->opt_layout = (mkcg_layout *)malloc(sizeof(mkcg_layout))))
+		return false;
+
+	layout = cg->opt_layout;
+	memset((void *)layout, 0, sizeof(mkcg_layout));
+
+	if (!strncmp(spec, "select:", 7)) {
+		if (!(layout->select = _mkcg_layout_bits(spec + 7, &end)) ||
+		    (*end != ','))
+			return false;
+		spec = end + 1;
+	}
+
+	if (!strcmp(spec, "glyph")) {
+		layout->preset = MKCG_LAYOUT_GLYPH;
+		return true;
+	}
+
+	if (!strcmp(spec, "scanline")) {
+		layout->preset = MKCG_LAYOUT_SCANLINE;
+		return true;
+	}
+
+	for (token = strtok_r(spec, ",", &save); token;
+			token = strtok_r(NULL, ",", &save)) {
+
+		if (!(bits = strchr(token, ':')))
+			return false;
+		*bits++ = '\0';
+
+		for (field = 0; field < MKCG_LAYOUT_FIELDS; field++)
+			if (!strcmp(token, _mkcg_layout_fields[field]))
+				break;
+
+		if ((field == MKCG_LAYOUT_FIELDS) ||
+		    (layout->number == sizeof(layout->piece) / sizeof(layout->piece[0])))
+			return false;
+
+		layout->piece[layout->number].field = field;
+		layout->piece[layout->number].bits  = _mkcg_layout_bits(bits, &end);
+		if (!layout->piece[layout->number].bits || *end)
+			return false;
+		layout->number++;
+	}
+
+	return layout->number > 0;
+}
+
+static unsigned int _mkcg_layout_log2(unsigned int value)
+{
+	unsigned int bits = 0;
+
+	while ((1U << bits) < value)
+		bits++;
+
+	return bits;
+}
+
+/* Expand a preset into its formula for the current character set. */
+static void _mkcg_layout_preset(mkcg_cg *cg, mkcg_layout *layout,
+		const unsigned int *need)
+{
+	static const unsigned int glyph[] = {
+		MKCG_LAYOUT_BANK, MKCG_LAYOUT_CHAR,
+		MKCG_LAYOUT_ROW, MKCG_LAYOUT_BYTE,
+	};
+	static const unsigned int scanline[] = {
+		MKCG_LAYOUT_ROW, MKCG_LAYOUT_BANK,
+		MKCG_LAYOUT_CHAR, MKCG_LAYOUT_BYTE,
+	};
+	const unsigned int	*order;
+	unsigned int		cnt;
+
+	order = layout->preset == MKCG_LAYOUT_SCANLINE ? scanline : glyph;
+
+	for (cnt = layout->number = 0; cnt < MKCG_LAYOUT_FIELDS; cnt++) {
+		if (!need[order[cnt]])
+			continue;
+		layout->piece[layout->number].field = order[cnt];
+		layout->piece[layout->number].bits  = need[order[cnt]];
+		layout->number++;
+	}
+}
+
+/*
+ * Resolve the formula into one address contribution table per field.
+ * The fields own disjoint address bits, so the address of a byte is
+ * just the or of the four contributions.
+ */
+static unsigned int *_mkcg_layout_resolve(mkcg_cg *cg, mkcg_layout *layout,
+		unsigned int *have, unsigned int *total)
+{
+	unsigned int	need[MKCG_LAYOUT_FIELDS];
+	unsigned int	shift[MKCG_LAYOUT_FIELDS];
+	unsigned int	*table, *contrib, field, value, cnt, pos;
+
+	need[MKCG_LAYOUT_CHAR]	= _mkcg_layout_log2(cg->number);
+	need[MKCG_LAYOUT_BANK]	= _mkcg_layout_log2(cg->banks);
+	need[MKCG_LAYOUT_ROW]	= _mkcg_layout_log2(cg->bound_bytes);
+	need[MKCG_LAYOUT_BYTE]	= _mkcg_layout_log2(cg->row_bytes);
+
+	/*
+	 * A preset wires the character address of the board, so the image
+	 * does not move with the size of the set.  A set too large for it
+	 * fails the check below.
+	 */
+	if (layout->preset != MKCG_LAYOUT_FORMULA) {
+		if (cg->rom_chars)
+			need[MKCG_LAYOUT_CHAR] = _mkcg_layout_log2(cg->rom_chars);
+		_mkcg_layout_preset(cg, layout, need);
+		need[MKCG_LAYOUT_CHAR] = _mkcg_layout_log2(cg->number);
+	}
+
+	memset((void *)have, 0, MKCG_LAYOUT_FIELDS * sizeof(unsigned int));
+	for (cnt = *total = 0; cnt < layout->number; cnt++) {
+		have[layout->piece[cnt].field] += layout->piece[cnt].bits;
+		*total += layout->piece[cnt].bits;
+	}
+
+	for (field = 0; field < MKCG_LAYOUT_FIELDS; field++) {
+		if (have[field] < need[field]) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("layout: field %s needs %u bits, got %u",
+						_mkcg_layout_fields[field],
+						need[field], have[field]);
+			return (unsigned int *)NULL;
+		}
+	}
+
+	if (*total > LAYOUT_MAX_BITS) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("layout: %u address bits, at most %u supported",
+					*total, LAYOUT_MAX_BITS);
+		return (unsigned int *)NULL;
+	}
+
+	if (layout->select >= *total) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("layout: %u select bits of %u address bits",
+					layout->select, *total);
+		return (unsigned int *)NULL;
+	}
+
+	for (field = cnt = 0; field < MKCG_LAYOUT_FIELDS; field++)
+		cnt += 1U << have[field];
+
+	if (!(table = (unsigned int *)calloc(cnt, sizeof(unsigned int))))
+		return (unsigned int *)NULL;
+
+	/* walk the pieces from the least significant address bit up */
+	memset((void *)shift, 0, sizeof(shift));
+	for (pos = 0, cnt = layout->number; cnt > 0; cnt--) {
+
+		field = layout->piece[cnt - 1].field;
+
+		for (contrib = table, value = 0; value < field; value++)
+			contrib += 1U << have[value];
+
+		for (value = 0; value < (1U << have[field]); value++)
+			contrib[value] |= ((value >> shift[field])
+					& MKCG_ROW_MASK(layout->piece[cnt - 1].bits)) << pos;
+
+		shift[field] += layout->piece[cnt - 1].bits;
+		pos += layout->piece[cnt - 1].bits;
+	}
+
+	return table;
+}
+
+/*
+ * Transpose the glyph-major table into the image.  The characters are
+ * taken in blocks, so the source glyphs of one block stay in the cache
+ * while all their scanlines are scattered, and a scanline-major target
+ * is written in runs of whole blocks.  Codes beyond the set fill the
+ * image with blank rows.
+ */
+#define MKCG_LAYOUT_TRANSPOSE(BITS) \
+static void _mkcg_layout_transpose_##BITS(mkcg_cg *cg, \
+		const uint##BITS##_t *rows, unsigned char *image, \
+		const unsigned int *table, const unsigned int *have) \
+{ \
+	const unsigned int	*c_addr	= table; \
+	const unsigned int	*k_addr	= c_addr + (1U << have[MKCG_LAYOUT_CHAR]); \
+	const unsigned int	*r_addr	= k_addr + (1U << have[MKCG_LAYOUT_BANK]); \
+	const unsigned int	*b_addr	= r_addr + (1U << have[MKCG_LAYOUT_ROW]); \
+	unsigned int		chars	= 1U << have[MKCG_LAYOUT_CHAR]; \
+	unsigned int		banks	= 1U << have[MKCG_LAYOUT_BANK]; \
+	unsigned int		hight	= 1U << have[MKCG_LAYOUT_ROW]; \
+	unsigned int		bytes	= 1U << have[MKCG_LAYOUT_BYTE]; \
+	unsigned int		cnt_k, cnt_c, block, cnt_h, byte, addr; \
+	uint32_t		bits, blank; \
+	uint32_t		neg	= cg->options & OPT_MKCG_NEGATED ? ~0U : 0; \
+	uint32_t		mask	= MKCG_ROW_MASK(cg->bound_bits); \
+	unsigned int		shift	= cg->options & OPT_MKCG_LEFTBOUND ? \
+						BITS - cg->bound_bits : 0; \
+\
+	blank = (neg & mask) << shift; \
+\
+	for (cnt_k = 0; cnt_k < banks; cnt_k++) { \
+		for (block = 0; block < chars; block += LAYOUT_BLOCK) { \
+			for (cnt_h = 0; cnt_h < hight; cnt_h++) { \
+				for (cnt_c = block; cnt_c < block + LAYOUT_BLOCK \
+						&& cnt_c < chars; cnt_c++) { \
+\
+					addr = k_addr[cnt_k] | c_addr[cnt_c] | r_addr[cnt_h]; \
+\
+					if (cnt_k < cg->banks && cnt_c < cg->number \
+					    && cnt_h < cg->bound_bytes) \
+						bits = ((rows[(cnt_k * cg->number + cnt_c) \
+							* cg->bound_bytes + cnt_h] ^ neg) \
+							& mask) << shift; \
+					else \
+						bits = blank; \
+\
+					for (byte = 0; byte < bytes; byte++) \
+						image[addr | b_addr[byte]] = \
+							byte < BITS / 8 ? \
+							mkcg_row_byte(cg, bits, byte) \
+							: (neg & 0xFF); \
+				} \
+			} \
+		} \
+	} \
+}
+
+MKCG_LAYOUT_TRANSPOSE(8)
+MKCG_LAYOUT_TRANSPOSE(16)
+MKCG_LAYOUT_TRANSPOSE(32)
+
+bool mkcg_out_layout(mkcg_cg *cg)
+{
+	unsigned int	have[MKCG_LAYOUT_FIELDS];
+	unsigned int	total, *table;
+	unsigned char	*image;
+	size_t		size, chip, line, base, addr, cnt;
+
+	if (!(table = _mkcg_layout_resolve(cg, cg->opt_layout, have, &total)))
+		return false;
+
+	size = (size_t)1 << total;
+	chip = size >> cg->opt_layout->select;
+	line = cg->bound_bytes * cg->row_bytes;
+
+	if (cg->options & OPT_MKCG_VERBOSE) {
+		INF("layout_bits:\t%u ", total);
+		INF("layout_size:\t%zu ", size);
+		INF("layout_chips:\t%zu ", size / chip);
+	}
+
+	if (!(image = (unsigned char *)malloc(size))) {
+		free(table);
+		return false;
+	}
+
+	MKCG_ROW_DISPATCH(cg, _mkcg_layout_transpose, cg,
+			(const void *)cg->rows, image, table, have);
+
+	/*
+	 * Same record width as the glyph-major dump, xxd -r reads both.
+	 * Every chip starts at address zero, an empty line separates it
+	 * from the one before (csplit -z - '/^$/' '{*}').
+	 */
+	for (base = 0; base < size; base += chip) {
+		if (base)
+			OUT(cg, "%s", "\n");
+		for (addr = 0; addr < chip; addr += line) {
+			OUT(cg, "%07zX: ", addr);
+			for (cnt = addr; cnt < addr + line && cnt < chip; cnt++)
+				OUT(cg, "%02X ", image[base + cnt]);
+			OUT(cg, "%s", "\n");
+		}
+	}
+
+	free(image);
+	free(table);
+
+	return true;
+}
@@ -0,0 +1,334 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+/*
+ * The lint mode does not decode any pixel.  Only the head of each
+ * file is read, the values line and the color table, what is all
+ * mkcg_isvalidch() needs to decide about a glyph.
+ */
+#define LINT_HEAD_SIZE	4096
+#define LINT_MAX_ERR	4
+#define LINT_MAX_THREADS 16
+
+typedef struct {
+
+	char		*filename;
+	unsigned int	nerr;
+	char		reason[LINT_MAX_ERR][96];
+
+} _mkcg_lint_file;
+
+typedef struct {
+
+	mkcg_cg		*cg;
+	_mkcg_lint_file	*file;
+	size_t		number;
+	size_t		alloc;
+	size_t		next;
+#if HAVE_PTHREAD
+	pthread_mutex_t	lock;
+#endif
+
+} _mkcg_lint_ctx;
+
+#define LINT_REASON(F,FORMAT,...) do { \
+		if ((F)->nerr < LINT_MAX_ERR) \
+			snprintf((F)->reason[(F)->nerr], sizeof((F)->reason[0]), \
+					FORMAT, __VA_ARGS__); \
+		(F)->nerr++; \
+	} while (0)
+
+static bool _mkcg_lint_add(_mkcg_lint_ctx *ctx, const char *filename)
+{
+	_mkcg_lint_file *file;
+
+	if (ctx->number == ctx->alloc) {
+		ctx->alloc = ctx->alloc ? ctx->alloc * 2 : 256;
+		file = (_mkcg_lint_file *)realloc(ctx->file,
+				ctx->alloc * sizeof(_mkcg_lint_file));
+		if (!file)
+			return false;
+		ctx->file = file;
+	}
+
+	file = &ctx->file[ctx->number];
+	if (!(file->filename = strdup(filename)))
+		return false;
+	file->nerr = 0;
+
+	ctx->number++;
+	return true;
+}
+
+static bool _mkcg_lint_collect(_mkcg_lint_ctx *ctx, const char *path)
+{
+	struct dirent	*entry;
+	struct stat	st;
+	size_t		len;
+	char		*sub;
+	DIR		*dir;
+	bool		ret = true;
+
+	if (stat(path, &st) || !S_ISDIR(st.st_mode))
+		return _mkcg_lint_add(ctx, path);
+
+	if (!(dir = opendir(path)))
+		return _mkcg_lint_add(ctx, path);
+
+	while (ret && (entry = readdir(dir))) {
+
+		if (entry->d_name[0] == '.')
+			continue;
+
+		len = strlen(path) + strlen(entry->d_name) + 2;
+		if (!(sub = (char *)malloc(len))) {
+			ret = false;
+			break;
+		}
+		snprintf(sub, len, "%s%s%s", path,
+				path[strlen(path) - 1] == '/' ? "" : "/", entry->d_name);
+
+		/* symlinked directories are not followed, they may loop */
+		if (lstat(sub, &st))
+			st.st_mode = 0;
+		else if (S_ISLNK(st.st_mode) && !stat(sub, &st) &&
+				S_ISDIR(st.st_mode)) {
+			free(sub);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode))
+			ret = _mkcg_lint_collect(ctx, sub);
+		else if ((len = strlen(sub)) > 4 && !strcmp(&sub[len - 4], ".xpm"))
+			ret = _mkcg_lint_add(ctx, sub);
+
+		free(sub);
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+static int _mkcg_lint_cmp(const void *a, const void *b)
+{
+	return strcmp(((const _mkcg_lint_file *)a)->filename,
+			((const _mkcg_lint_file *)b)->filename);
+}
+
+/* Return the next C string literal out of the head, skip comments. */
+static char *_mkcg_lint_string(char **pos, char *end, size_t *len)
+{
+	char *p = *pos, *s;
+
+	while (p < end) {
+		if ((p + 1 < end) && (p[0] == '/') && (p[1] == '*')) {
+			for (p += 2; (p + 1 < end) && !((p[0] == '*') && (p[1] == '/')); p++);
+			p += 2;
+			continue;
+		}
+		if (*p++ == '"')
+			break;
+	}
+
+	for (s = p; (p < end) && (*p != '"'); p++);
+	if (p >= end)
+		return (char *)NULL;
+
+	*len = p - s;
+	*pos = p + 1;
+	return s;
+}
+
+static void _mkcg_lint_check(mkcg_cg *cg, _mkcg_lint_file *file)
+{
+	unsigned int	width, height, ncolors, cpp, cnt;
+	char		head[LINT_HEAD_SIZE + 1];
+	char		*pos, *end, *str, *key, *value, *save;
+	size_t		len;
+	ssize_t		got;
+	bool		dot = false;
+	int		fd;
+
+	if ((fd = open(file->filename, O_RDONLY)) < 0) {
+		LINT_REASON(file, "%s", "can not open file");
+		return;
+	}
+	got = pread(fd, head, LINT_HEAD_SIZE, 0);
+	close(fd);
+
+	if (got <= 0) {
+		LINT_REASON(file, "%s", "can not read file");
+		return;
+	}
+
+	head[got] = '\0';
+	pos = head;
+	end = head + got;
+
+	if (!strstr(head, "XPM") ||
+	    !(str = _mkcg_lint_string(&pos, end, &len)) ||
+	    (sscanf(str, "%u %u %u %u", &width, &height, &ncolors, &cpp) != 4)) {
+		LINT_REASON(file, "%s", "no pixmap file");
+		return;
+	}
+
+	if ((width != cg->exp_ch_width) || (height != cg->exp_ch_hight))
+		LINT_REASON(file, "dimension validation: %u x %u (%u x %u expected)",
+				width, height, cg->exp_ch_width, cg->exp_ch_hight);
+
+	if (ncolors > cg->exp_ch_max_color)
+		LINT_REASON(file, "too many colors: %u colors (%u colors expected)",
+				ncolors, cg->exp_ch_max_color);
+
+	for (cnt = 0; cnt < ncolors; cnt++) {
+
+		if (!(str = _mkcg_lint_string(&pos, end, &len)) || (len < cpp)) {
+			LINT_REASON(file, "%s", "truncated color table");
+			return;
+		}
+
+		/* skip the pixel chars, then walk the key/value pairs */
+		str[len] = '\0';
+		for (key = strtok_r(str + cpp, " \t", &save); key;
+				key = strtok_r(NULL, " \t", &save)) {
+			if (!(value = strtok_r(NULL, " \t", &save)))
+				break;
+			if (!strcmp(key, "c") && !strcmp(value, cg->exp_ch_dot_color))
+				dot = true;
+		}
+	}
+
+	if (!dot && (ncolors != cg->exp_ch_max_color - 1))
+		LINT_REASON(file, "missing dot color: %s expected",
+				cg->exp_ch_dot_color);
+}
+
+static void *_mkcg_lint_worker(void *arg)
+{
+	_mkcg_lint_ctx	*ctx = (_mkcg_lint_ctx *)arg;
+	size_t		cnt;
+
+	while (true) {
+
+#if HAVE_PTHREAD
+		pthread_mutex_lock(&ctx->lock);
+#endif
+		cnt = ctx->next++;
+#if HAVE_PTHREAD
+		pthread_mutex_unlock(&ctx->lock);
+#endif
+
+		if (cnt >= ctx->number)
+			break;
+
+		_mkcg_lint_check(ctx->cg, &ctx->file[cnt]);
+	}
+
+	return NULL;
+}
+
+bool mkcg_lint(mkcg_cg *cg, int argc, char **argv)
+{
+	_mkcg_lint_ctx	ctx;
+	size_t		cnt, nerr, nbad;
+	unsigned int	cnt_e;
+	int		arg;
+#if HAVE_PTHREAD
+	pthread_t	thread[LINT_MAX_THREADS];
+	long		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	long		cnt_t;
+#endif
+
+	memset((void *)&ctx, 0, sizeof(ctx));
+	ctx.cg = cg;
+
+	for (arg = 0; arg < argc; arg++) {
+		if (!_mkcg_lint_collect(&ctx, argv[arg])) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("%s", "no memory for file list");
+			nerr = 1;
+			goto out;
+		}
+	}
+
+	qsort(ctx.file, ctx.number, sizeof(_mkcg_lint_file), _mkcg_lint_cmp);
+
+#if HAVE_PTHREAD
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	if (nthreads > LINT_MAX_THREADS)
+		nthreads = LINT_MAX_THREADS;
+	if (nthreads > (long)(ctx.number / 64))
+		nthreads = ctx.number / 64;
+
+	/* the calling thread always takes its share */
+	for (cnt_t = 0; cnt_t < nthreads - 1; cnt_t++)
+		if (pthread_create(&thread[cnt_t], NULL, _mkcg_lint_worker, &ctx))
+			break;
+	nthreads = cnt_t;
+
+	_mkcg_lint_worker(&ctx);
+
+	for (cnt_t = 0; cnt_t < nthreads; cnt_t++)
+		pthread_join(thread[cnt_t], NULL);
+
+	pthread_mutex_destroy(&ctx.lock);
+#else
+	_mkcg_lint_worker(&ctx);
+#endif
+
+	for (cnt = nerr = nbad = 0; cnt < ctx.number; cnt++) {
+
+		if (!ctx.file[cnt].nerr)
+			continue;
+
+		for (cnt_e = 0; cnt_e < ctx.file[cnt].nerr
+				&& cnt_e < LINT_MAX_ERR; cnt_e++)
+			OUT(cg, "%s: %s\n", ctx.file[cnt].filename,
+					ctx.file[cnt].reason[cnt_e]);
+
+		nerr += ctx.file[cnt].nerr;
+		nbad++;
+	}
+
+	fflush(cg->out);
+
+	if (cg->options & OPT_MKCG_VERBOSE)
+		INF("lint: %zu files, %zu with %zu violations",
+				ctx.number, nbad, nerr);
+
+out:
+	for (cnt = 0; cnt < ctx.number; cnt++)
+		free(ctx.file[cnt].filename);
+	if (ctx.file) free(ctx.file);
+
+	return nerr == 0;
+}
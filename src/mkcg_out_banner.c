@@ -21,34 +21,33 @@
 
 #include "pcmtools.h"
 
-bool mkcg_out_banner(mkcg_cg *cg, mkcg_ch *ch)
+bool mkcg_out_banner(mkcg_cg *cg, size_t glyph)
 {
-	unsigned int	cnt_w, cnt_h, bit, bits;
+	unsigned int	cnt_w, cnt_h, bit;
+	uint32_t	bits;
 
-	OUT("%s\n", "____________________");
+	OUT(cg, "%s\n", "____________________");
 
-	for (cnt_h = 0; cnt_h < ch->image.height; cnt_h++) {
+	for (cnt_h = 0; cnt_h < cg->exp_ch_hight; cnt_h++) {
 
-		OUT("%s", "|");
+		OUT(cg, "%s", "|");
 
-		for (cnt_w = bits = 0; cnt_w < ch->image.width; cnt_w++) {
+		bits = mkcg_row_get(cg, glyph * cg->bound_bytes + cnt_h);
 
-			bit = (ch->image.data[cnt_h * ch->image.width + cnt_w]
-					== ch->dot_color_id) ? 1 : 0;
+		for (cnt_w = cg->exp_ch_width; cnt_w > 0; cnt_w--) {
 
-			OUT("%s", bit	? cg->options & OPT_MKCG_INVERSE ? " " : "#"
-					: cg->options & OPT_MKCG_INVERSE ? "#" : " ");
+			bit = (bits >> (cnt_w - 1)) & 1;
 
-			bits += bit;
-			bits <<= 1;
+			OUT(cg, "%s", bit	? cg->options & OPT_MKCG_INVERSE ? " " : "#"
+					: cg->options & OPT_MKCG_INVERSE ? "#" : " ");
 
 		}
 
-		bits >>= 1;
 		bits = cg->options & OPT_MKCG_NEGATED ? ~bits : bits;
-		bits &= (1 << cg->bound_bits) - 1;
+		bits &= MKCG_ROW_MASK(cg->bound_bits);
 
-		OUT("|  0x%02X\n", cg->options & OPT_MKCG_LEFTBOUND ? (bits << (8 - cg->bound_bits)) : bits);
+		OUT(cg, "|  0x%0*X\n", cg->row_bytes * 2, cg->options & OPT_MKCG_LEFTBOUND ?
+				(bits << (cg->row_bytes * 8 - cg->bound_bits)) : bits);
 
 	}
 
@@ -0,0 +1,325 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+#define COLNUM		2
+#define COLID_NONE	0
+#define COLID_DOT	1
+
+/*
+ * The glyph atlas holds every character of the loaded set already
+ * expanded into pixel rows of color ids, derived banks included, so
+ * the upper codes show e.g. the inverse bank.  One more blank character
+ * at the end stands for all codes outside of the set.  A screen frame is
+ * then composed by plain row copies out of this atlas.
+ */
+static unsigned int *_mkcg_screen_atlas(mkcg_cg *cg)
+{
+	unsigned int	cnt, cnt_w, cnt_h, dot, none;
+	unsigned int	number	= cg->banks * cg->number;
+	unsigned int	width	= cg->exp_ch_width;
+	unsigned int	hight	= cg->exp_ch_hight;
+	unsigned int	*atlas, *pixel;
+	uint32_t	bits;
+
+	atlas = (unsigned int *)malloc((number + 1) * hight * width
+			* sizeof(unsigned int));
+	if (!atlas)
+		return (unsigned int *)NULL;
+
+	dot  = cg->options & OPT_MKCG_INVERSE ? COLID_NONE : COLID_DOT;
+	none = cg->options & OPT_MKCG_INVERSE ? COLID_DOT : COLID_NONE;
+
+	for (cnt = 0, pixel = atlas; cnt < number; cnt++) {
+		for (cnt_h = 0; cnt_h < hight; cnt_h++) {
+			bits = mkcg_row_get(cg, cnt * cg->bound_bytes + cnt_h);
+			for (cnt_w = width; cnt_w > 0; cnt_w--) {
+				*pixel++ = ((bits >> (cnt_w - 1)) & 1) ? dot : none;
+			}
+		}
+	}
+
+	for (cnt = 0; cnt < hight * width; cnt++)
+		*pixel++ = none;
+
+	return atlas;
+}
+
+static void _mkcg_screen_compose(mkcg_cg *cg, unsigned int *atlas,
+		const unsigned char *frame, unsigned int *pixeldata)
+{
+	unsigned int	col_cnt, row_cnt, cnt_h, glyph;
+	unsigned int	number	= cg->banks * cg->number;
+	unsigned int	width	= cg->exp_ch_width;
+	unsigned int	hight	= cg->exp_ch_hight;
+	size_t		size	= width * sizeof(unsigned int);
+
+	for (row_cnt = 0; row_cnt < cg->screen_rows; row_cnt++) {
+		for (cnt_h = 0; cnt_h < hight; cnt_h++) {
+			for (col_cnt = 0; col_cnt < cg->screen_cols; col_cnt++) {
+
+				glyph = frame[row_cnt * cg->screen_cols + col_cnt];
+				if (glyph >= number)
+					glyph = number;
+
+				memcpy(pixeldata, &atlas[(glyph * hight + cnt_h) * width], size);
+				pixeldata += width;
+
+			}
+		}
+	}
+}
+
+static bool _mkcg_screen_write_pbm(mkcg_cg *cg, unsigned int *pixeldata,
+		unsigned int pixel_in_cols, unsigned int pixel_in_rows,
+		unsigned char *line)
+{
+	unsigned int	cnt_w, cnt_h;
+	size_t		bytes	= (pixel_in_cols + 7) / 8;
+
+	/* portable bitmap, binary variant: 1 is black */
+	OUT(cg, "P4\n%u %u\n", pixel_in_cols, pixel_in_rows);
+
+	for (cnt_h = 0; cnt_h < pixel_in_rows; cnt_h++) {
+
+		memset(line, 0, bytes);
+		for (cnt_w = 0; cnt_w < pixel_in_cols; cnt_w++) {
+			if (*pixeldata++ == COLID_DOT)
+				line[cnt_w >> 3] |= 0x80 >> (cnt_w & 7);
+		}
+
+		if (fwrite(line, 1, bytes, cg->out) != bytes)
+			return false;
+
+	}
+
+	return true;
+}
+
+static bool _mkcg_screen_write_xpm(mkcg_cg *cg, unsigned int *pixeldata,
+		unsigned int pixel_in_cols, unsigned int pixel_in_rows)
+{
+	XpmColor	colortable[COLNUM];
+	XpmImage	image;
+
+	memset((void *)colortable, 0, sizeof(colortable));
+	colortable[COLID_NONE].string	= " ";
+	colortable[COLID_NONE].c_color	= "None";
+	colortable[COLID_DOT].string	= "#";
+	colortable[COLID_DOT].c_color	= "#000000";
+
+	memset((void *)&image, 0, sizeof(image));
+
+	image.width		= pixel_in_cols;
+	image.height		= pixel_in_rows;
+	image.cpp		= 1;
+	image.ncolors		= COLNUM;
+	image.colorTable	= colortable;
+	image.data		= pixeldata;
+
+	return mkcg_out_xpmimage(cg, &image);
+}
+
+/*
+ * True if PATTERN holds exactly one %u conversion (flags and width
+ * allowed) for the frame number and nothing else but %%.
+ */
+static bool _mkcg_screen_pattern_ok(const char *pattern)
+{
+	unsigned int	conv = 0;
+	const char	*pos;
+
+	for (pos = pattern; (pos = strchr(pos, '%')); pos++) {
+		if (*++pos == '%')
+			continue;
+		pos += strspn(pos, "0-# +");
+		pos += strspn(pos, "0123456789");
+		if (*pos != 'u')
+			return false;
+		conv++;
+	}
+
+	return conv == 1;
+}
+
+bool mkcg_screen_parse(mkcg_cg *cg, char *pattern)
+{
+	if (!_mkcg_screen_pattern_ok(pattern)) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("render output needs exactly one %%u: %s", pattern);
+		return false;
+	}
+
+	cg->opt_render_output = pattern;
+	return true;
+}
+
+/*
+ * Write one frame to the output of the context, or to a file of its
+ * own named by the render output pattern and the frame number, counted
+ * over all dumps.  Without a pattern only PBM frames can follow each
+ * other on one stream, a reader can not split concatenated XPM.
+ */
+static bool _mkcg_screen_write(mkcg_cg *cg, unsigned int frame,
+		unsigned int *pixeldata, unsigned int pixel_in_cols,
+		unsigned int pixel_in_rows, unsigned char *line)
+{
+	FILE	*out = cg->out;
+	char	*name = (char *)NULL;
+	int	len;
+	bool	ret;
+
+	if (cg->opt_render_output) {
+
+		/* the pattern is checked, it takes no other argument */
+		len = snprintf(NULL, 0, cg->opt_render_output, frame);
+		if ((len < 0) || !(name = (char *)malloc(len + 1)))
+			return false;
+		snprintf(name, len + 1, cg->opt_render_output, frame);
+
+		if (!(cg->out = fopen(name, "wb"))) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("can not create frame: %s", name);
+			cg->out = out;
+			free(name);
+			return false;
+		}
+
+	} else if (frame && (cg->opt_render_format == MKCG_RENDER_XPM)) {
+
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("%s", "more than one XPM frame needs a render output pattern");
+		return false;
+
+	}
+
+	if (cg->opt_render_format == MKCG_RENDER_PBM)
+		ret = _mkcg_screen_write_pbm(cg, pixeldata,
+				pixel_in_cols, pixel_in_rows, line);
+	else
+		ret = _mkcg_screen_write_xpm(cg, pixeldata,
+				pixel_in_cols, pixel_in_rows);
+
+	if (name) {
+		if (fclose(cg->out))
+			ret = false;
+		if (!ret && !(cg->options & OPT_MKCG_QUIET))
+			ERR("can not write frame: %s", name);
+		cg->out = out;
+		free(name);
+	}
+
+	return ret;
+}
+
+bool mkcg_out_screen(mkcg_cg *cg)
+{
+	unsigned int	cnt, frame_cnt, frame_total = 0;
+	unsigned int	pixel_in_cols	= cg->screen_cols * cg->exp_ch_width;
+	unsigned int	pixel_in_rows	= cg->screen_rows * cg->exp_ch_hight;
+	size_t		frame_size	= cg->screen_cols * cg->screen_rows;
+	size_t		got;
+	unsigned int	*atlas, *pixeldata;
+	unsigned char	*frame, *line;
+	bool		ret		= true;
+	FILE		*fp;
+
+	if (cg->options & OPT_MKCG_VERBOSE) {
+		INF("screen_cols:\t%d ", cg->screen_cols);
+		INF("screen_rows:\t%d ", cg->screen_rows);
+		INF("pixel_in_cols:\t%d ", pixel_in_cols);
+		INF("pixel_in_rows:\t%d ", pixel_in_rows);
+	}
+
+	atlas	  = _mkcg_screen_atlas(cg);
+	pixeldata = (unsigned int *)malloc(pixel_in_cols * pixel_in_rows
+			* sizeof(unsigned int));
+	frame	  = (unsigned char *)malloc(frame_size);
+	line	  = (unsigned char *)malloc((pixel_in_cols + 7) / 8);
+
+	if (!atlas || !pixeldata || !frame || !line) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("%s", "no memory for screen rendering");
+		ret = false;
+		goto out;
+	}
+
+	for (cnt = 0; ret && cnt < cg->opt_screen_number; cnt++) {
+
+		if (strcmp(cg->opt_screen_files[cnt], "-") == 0)
+			fp = stdin;
+		else if (!(fp = fopen(cg->opt_screen_files[cnt], "rb"))) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("can not open screen dump: %s",
+						cg->opt_screen_files[cnt]);
+			ret = false;
+			break;
+		}
+
+		for (frame_cnt = 0; ret; frame_cnt++) {
+
+			got = fread(frame, 1, frame_size, fp);
+			if (got < frame_size) {
+				/* a cut off frame is a broken dump */
+				if (got) {
+					if (!(cg->options & OPT_MKCG_QUIET))
+						ERR("screen dump %s: frame %u cut off after %zu of %zu bytes",
+								cg->opt_screen_files[cnt],
+								frame_cnt, got, frame_size);
+					ret = false;
+				}
+				break;
+			}
+
+			if (cg->options & OPT_MKCG_VERBOSE)
+				INF("render: %s frame %u ... ",
+						cg->opt_screen_files[cnt], frame_cnt);
+
+			_mkcg_screen_compose(cg, atlas, frame, pixeldata);
+
+			ret = _mkcg_screen_write(cg, frame_total++, pixeldata,
+					pixel_in_cols, pixel_in_rows, line);
+
+		}
+
+		if (ferror(fp)) {
+			if (!(cg->options & OPT_MKCG_QUIET))
+				ERR("can not read screen dump: %s",
+						cg->opt_screen_files[cnt]);
+			ret = false;
+		}
+
+		if (fp != stdin)
+			fclose(fp);
+
+	}
+
+	fflush(cg->out);
+
+out:
+	if (line) free(line);
+	if (frame) free(frame);
+	if (pixeldata) free(pixeldata);
+	if (atlas) free(atlas);
+
+	return ret;
+}
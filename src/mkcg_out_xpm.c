@@ -56,6 +56,61 @@ static void _mkcg_UnsetXpmColor(XpmColor *entry)
 #undef FREE_AT_POINTER
 }
 
+/*
+ * Write an image in the XPM 3 format libXpm writes itself, but to the
+ * output stream of the context.  libXpm can only write to a named file,
+ * which is a shared resource for contexts on concurrent threads.  The
+ * variable name is kept as libXpm named it for "/dev/stdout".
+ */
+bool mkcg_out_xpmimage(mkcg_cg *cg, XpmImage *image)
+{
+	unsigned int	cnt, cnt_w, cnt_h, key;
+	char		*line, *pos;
+	const char	*value[5];
+
+	static const char *const keys[] = { "s", "m", "g4", "g", "c" };
+
+	if (!(line = (char *)malloc(image->width * image->cpp + 1)))
+		return false;
+
+	OUT(cg, "/* XPM */\nstatic char * %s[] = {\n", "stdout");
+	OUT(cg, "\"%u %u %u %u\",\n", image->width, image->height,
+			image->ncolors, image->cpp);
+
+	for (cnt = 0; cnt < image->ncolors; cnt++) {
+
+		value[0] = image->colorTable[cnt].symbolic;
+		value[1] = image->colorTable[cnt].m_color;
+		value[2] = image->colorTable[cnt].g4_color;
+		value[3] = image->colorTable[cnt].g_color;
+		value[4] = image->colorTable[cnt].c_color;
+
+		OUT(cg, "\"%s", image->colorTable[cnt].string);
+		for (key = 0; key < 5; key++)
+			if (value[key] && *value[key])
+				OUT(cg, "\t%s %s", keys[key], value[key]);
+		OUT(cg, "%s", "\",\n");
+	}
+
+	for (cnt_h = 0; cnt_h < image->height; cnt_h++) {
+
+		for (cnt_w = 0, pos = line; cnt_w < image->width; cnt_w++) {
+			memcpy(pos, image->colorTable[image->data[
+					cnt_h * image->width + cnt_w]].string,
+					image->cpp);
+			pos += image->cpp;
+		}
+		*pos = '\0';
+
+		OUT(cg, "\"%s\"%s\n", line,
+				cnt_h + 1 < image->height ? "," : "};");
+	}
+
+	free(line);
+
+	return !ferror(cg->out);
+}
+
 bool mkcg_out_xpm(mkcg_cg *cg)
 {
 #define COLNUM		4
@@ -65,13 +120,14 @@ bool mkcg_out_xpm(mkcg_cg *cg)
 #define COLID_UNDEF	3
 #define BORDER_WIDTH	1
 	unsigned int	pixel_cnt, pixel_col_cnt, pixel_row_cnt,
-			col_cnt, row_cnt, char_cnt, pixel_in_char;
+			col_cnt, row_cnt, char_cnt, row_in_char, col_in_char;
+	unsigned int	number		= cg->banks * cg->number;
 	unsigned int	cols		= cg->opt_overview_cols;
-	unsigned int	rows_full	= cg->number / cols;
-	unsigned int	parts_last_row	= cg->number - (cols * rows_full);
-	unsigned int	pixel_in_col	= cg->ch[0].image.width;
+	unsigned int	rows_full	= number / cols;
+	unsigned int	parts_last_row	= number - (cols * rows_full);
+	unsigned int	pixel_in_col	= cg->exp_ch_width;
 	unsigned int	pixel_in_cols	= cols * pixel_in_col;
-	unsigned int	pixel_in_row	= cg->ch[0].image.height;
+	unsigned int	pixel_in_row	= cg->exp_ch_hight;
 	unsigned int	pixel_in_rows	= (parts_last_row ?
 						rows_full + 1 : rows_full)
 						* pixel_in_row;
@@ -79,8 +135,7 @@ bool mkcg_out_xpm(mkcg_cg *cg)
 	unsigned int	*pixeldata;
 	XpmColor	*colortable;
 	XpmImage	image;
-
-	char filename[] = "/dev/stdout";
+	bool		ret;
 
 	colortable = (XpmColor *)malloc(COLNUM * sizeof(XpmColor));
 	pixeldata  = (unsigned int *)malloc(pixel_num * sizeof(unsigned int));
@@ -117,15 +172,13 @@ bool mkcg_out_xpm(mkcg_cg *cg)
 		col_cnt		= pixel_col_cnt / pixel_in_col;
 		row_cnt		= pixel_row_cnt / pixel_in_row;
 		char_cnt	= col_cnt + (row_cnt * cols);
-		pixel_in_char	= ((pixel_row_cnt - (row_cnt * pixel_in_row)) * pixel_in_col)
-				+ (pixel_cnt % pixel_in_col);
+		row_in_char	= pixel_row_cnt - (row_cnt * pixel_in_row);
+		col_in_char	= pixel_cnt % pixel_in_col;
 
 		/* pixel in character */
-		if (char_cnt < cg->number) {
-			if (		(cg->ch[char_cnt].image.width  == pixel_in_col)
-				&&	(cg->ch[char_cnt].image.height == pixel_in_row)
-				&&	(cg->ch[char_cnt].image.data[pixel_in_char]
-						== cg->ch[char_cnt].dot_color_id)		) {
+		if (char_cnt < number) {
+			if ((mkcg_row_get(cg, char_cnt * cg->bound_bytes + row_in_char)
+					>> (pixel_in_col - 1 - col_in_char)) & 1) {
 
 				pixeldata[pixel_cnt] = COLID_DOT;
 
@@ -149,13 +202,15 @@ bool mkcg_out_xpm(mkcg_cg *cg)
 	image.colorTable	= colortable;
 	image.data		= pixeldata;
 
-	XpmWriteFileFromXpmImage(filename, &image, NULL);
+	ret = mkcg_out_xpmimage(cg, &image);
 
 	_mkcg_UnsetXpmColor(&colortable[0]);
 	_mkcg_UnsetXpmColor(&colortable[1]);
 	_mkcg_UnsetXpmColor(&colortable[2]);
+	_mkcg_UnsetXpmColor(&colortable[3]);
 
 	if (colortable) free(colortable);
+	if (pixeldata) free(pixeldata);
 
-	return true;
+	return ret;
 }
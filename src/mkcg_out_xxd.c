@@ -21,45 +21,40 @@
 
 #include "pcmtools.h"
 
-bool mkcg_out_xxd(mkcg_cg *cg, mkcg_ch *ch, unsigned int addr)
-{
-	unsigned int	cnt, cnt_w, cnt_h, bit, bits, bytes;
-
-	OUT("%07X: ", addr);
-
-	bytes = 0;
-
-	for (cnt_h = 0; cnt_h < ch->image.height; cnt_h++) {
-
-		for (cnt_w = bits = 0; cnt_w < ch->image.width; cnt_w++) {
-
-			bit = (ch->image.data[cnt_h * ch->image.width + cnt_w]
-					== ch->dot_color_id) ? 1 : 0;
-			bits += bit;
-			bits <<= 1;
-
-		}
-
-		bytes++;
-
-		bits >>= 1;
-		bits = cg->options & OPT_MKCG_NEGATED ? ~bits : bits;
-		bits &= (1 << cg->bound_bits) - 1;
-
-		OUT("%02X ", cg->options & OPT_MKCG_LEFTBOUND ? (bits << (8 - cg->bound_bits)) : bits);
-
-	}
+#define MKCG_OUT_XXD(BITS) \
+static void _mkcg_out_xxd_##BITS(mkcg_cg *cg, const uint##BITS##_t *rows) \
+{ \
+	unsigned int	cnt, byte; \
+	uint32_t	bits; \
+	uint32_t	neg	= cg->options & OPT_MKCG_NEGATED ? ~0U : 0; \
+	uint32_t	mask	= MKCG_ROW_MASK(cg->bound_bits); \
+	unsigned int	shift	= cg->options & OPT_MKCG_LEFTBOUND ? \
+					BITS - cg->bound_bits : 0; \
+\
+	for (cnt = 0; cnt < cg->bound_bytes; cnt++) { \
+\
+		bits = ((rows[cnt] ^ neg) & mask) << shift; \
+\
+		for (byte = 0; byte < BITS / 8; byte++) \
+			OUT(cg, "%02X ", mkcg_row_byte(cg, bits, byte)); \
+\
+	} \
+}
 
-	for (cnt = 0; cnt < cg->bound_bytes - bytes; cnt++) {
+MKCG_OUT_XXD(8)
+MKCG_OUT_XXD(16)
+MKCG_OUT_XXD(32)
 
-		bits = cg->options & OPT_MKCG_NEGATED ? ~0 : 0;
-		bits &= (1 << cg->bound_bits) - 1;
+bool mkcg_out_xxd(mkcg_cg *cg, size_t glyph, unsigned int addr)
+{
+	const char *rows = (const char *)cg->rows
+			+ glyph * cg->bound_bytes * cg->row_bytes;
 
-		OUT("%02X ", cg->options & OPT_MKCG_LEFTBOUND ? (bits << (8 - cg->bound_bits)) : bits);
+	OUT(cg, "%07X: ", addr);
 
-	}
+	MKCG_ROW_DISPATCH(cg, _mkcg_out_xxd, cg, (const void *)rows);
 
-	OUT("%s", "\n");
+	OUT(cg, "%s", "\n");
 
 	return true;
 }
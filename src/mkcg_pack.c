@@ -0,0 +1,74 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+bool mkcg_pack(mkcg_cg *cg)
+{
+	unsigned int	cnt, cnt_w, cnt_h, bits;
+	size_t		row;
+	mkcg_ch		*ch;
+	uint64_t	ts;
+
+	if ((cg->exp_ch_width > cg->bound_bits) || (cg->bound_bits > 32) ||
+	    (cg->exp_ch_hight > cg->bound_bytes))
+		return false;
+
+	cg->row_bytes = cg->bound_bits > 16 ? 4 : cg->bound_bits > 8 ? 2 : 1;
+
+	cg->banks = 1 + cg->opt_derive_number;
+	cg->rows = calloc(cg->banks * cg->number * cg->bound_bytes,
+			cg->row_bytes);
+	if (!cg->rows)
+		return false;
+
+	for (cnt = 0, row = 0; cnt < cg->number; cnt++) {
+
+		ch = &cg->ch[cnt];
+
+		MKCG_TRACE_BEGIN(cg, encode, cnt, ts);
+
+		/* a glyph of a container is packed already, it has no image */
+		for (cnt_h = 0; ch->packed && (cnt_h < cg->bound_bytes); cnt_h++)
+			mkcg_row_set(cg, row + cnt_h,
+					mkcg_container_row(cg, ch->packed, cnt_h));
+
+		for (cnt_h = 0; cnt_h < ch->image.height; cnt_h++) {
+
+			for (cnt_w = bits = 0; cnt_w < ch->image.width; cnt_w++) {
+
+				bits <<= 1;
+				bits |= (ch->image.data[cnt_h * ch->image.width + cnt_w]
+						== ch->dot_color_id) ? 1 : 0;
+
+			}
+
+			mkcg_row_set(cg, row + cnt_h, bits);
+
+		}
+
+		row += cg->bound_bytes;
+
+		MKCG_TRACE_END(cg, encode, cnt, ts);
+	}
+
+	return true;
+}
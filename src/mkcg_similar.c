@@ -0,0 +1,306 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+/*
+ * Every glyph of the base bank becomes a bit signature of its packed
+ * rows, stored word-major (all first words, then all second words, ...)
+ * so the distance of one glyph to all following glyphs is a straight
+ * XOR and popcount loop over contiguous memory.
+ */
+#define SIMILAR_CHUNK		32
+#define SIMILAR_MAX_THREADS	16
+
+typedef struct {
+
+	uint32_t	a;
+	uint32_t	b;
+	uint32_t	dist;
+
+} _mkcg_similar_pair;
+
+typedef struct {
+
+	_mkcg_similar_pair	*pair;
+	size_t			number;
+	size_t			alloc;
+	bool			nomem;
+
+} _mkcg_similar_list;
+
+typedef struct {
+
+	const uint64_t	*sig;
+	size_t		words;
+	size_t		number;
+	unsigned int	threshold;
+	size_t		next;
+#if HAVE_PTHREAD
+	pthread_mutex_t	lock;
+#endif
+
+} _mkcg_similar_ctx;
+
+typedef struct {
+
+	_mkcg_similar_ctx	*ctx;
+	_mkcg_similar_list	list;
+
+} _mkcg_similar_job;
+
+#if HAVE_TARGET_CLONES
+__attribute__((target_clones("popcnt", "default")))
+#endif
+static void _mkcg_similar_row(const uint64_t *sig, size_t words,
+		size_t number, size_t glyph, uint16_t *dist)
+{
+	const uint64_t	*word;
+	uint64_t	a;
+	size_t		cnt, cnt_w;
+
+	for (cnt = glyph + 1; cnt < number; cnt++)
+		dist[cnt] = 0;
+
+	for (cnt_w = 0; cnt_w < words; cnt_w++) {
+		word = &sig[cnt_w * number];
+		a = word[glyph];
+		for (cnt = glyph + 1; cnt < number; cnt++)
+			dist[cnt] += __builtin_popcountll(a ^ word[cnt]);
+	}
+}
+
+static void _mkcg_similar_add(_mkcg_similar_list *list,
+		size_t a, size_t b, unsigned int dist)
+{
+	_mkcg_similar_pair *pair;
+
+	if (list->number == list->alloc) {
+		list->alloc = list->alloc ? list->alloc * 2 : 256;
+		pair = (_mkcg_similar_pair *)realloc(list->pair,
+				list->alloc * sizeof(_mkcg_similar_pair));
+		if (!pair) {
+			list->nomem = true;
+			return;
+		}
+		list->pair = pair;
+	}
+
+	list->pair[list->number].a	= a;
+	list->pair[list->number].b	= b;
+	list->pair[list->number].dist	= dist;
+	list->number++;
+}
+
+static void *_mkcg_similar_worker(void *arg)
+{
+	_mkcg_similar_job	*job = (_mkcg_similar_job *)arg;
+	_mkcg_similar_ctx	*ctx = job->ctx;
+	size_t			first, cnt, cnt_b;
+	uint16_t		*dist;
+
+	if (!(dist = (uint16_t *)malloc(ctx->number * sizeof(uint16_t)))) {
+		job->list.nomem = true;
+		return NULL;
+	}
+
+	while (!job->list.nomem) {
+
+#if HAVE_PTHREAD
+		pthread_mutex_lock(&ctx->lock);
+#endif
+		first = ctx->next;
+		ctx->next += SIMILAR_CHUNK;
+#if HAVE_PTHREAD
+		pthread_mutex_unlock(&ctx->lock);
+#endif
+
+		if (first >= ctx->number)
+			break;
+
+		for (cnt = first; cnt < first + SIMILAR_CHUNK && cnt < ctx->number; cnt++) {
+
+			_mkcg_similar_row(ctx->sig, ctx->words, ctx->number, cnt, dist);
+
+			for (cnt_b = cnt + 1; cnt_b < ctx->number; cnt_b++)
+				if (dist[cnt_b] <= ctx->threshold)
+					_mkcg_similar_add(&job->list, cnt, cnt_b, dist[cnt_b]);
+		}
+	}
+
+	free(dist);
+	return NULL;
+}
+
+static int _mkcg_similar_cmp(const void *a, const void *b)
+{
+	const _mkcg_similar_pair *pa = (const _mkcg_similar_pair *)a;
+	const _mkcg_similar_pair *pb = (const _mkcg_similar_pair *)b;
+
+	if (pa->dist != pb->dist)
+		return pa->dist < pb->dist ? -1 : 1;
+	if (pa->a != pb->a)
+		return pa->a < pb->a ? -1 : 1;
+	return pa->b < pb->b ? -1 : pa->b > pb->b;
+}
+
+/* Write STR as a JSON string literal, shared with the trace writer. */
+void mkcg_json_string(FILE *fp, const char *str)
+{
+	fprintf(fp, "%s", "\"");
+	for (; *str; str++) {
+		if ((*str == '"') || (*str == '\\'))
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char)*str);
+		else
+			fprintf(fp, "%c", *str);
+	}
+	fprintf(fp, "%s", "\"");
+}
+
+bool mkcg_similar(mkcg_cg *cg)
+{
+	_mkcg_similar_ctx	ctx;
+	_mkcg_similar_job	job[SIMILAR_MAX_THREADS];
+	_mkcg_similar_list	all;
+	size_t			bytes	= cg->bound_bytes * cg->row_bytes;
+	size_t			cnt, cnt_w, cnt_j;
+	uint64_t		*sig, word;
+	long			njobs	= 1;
+	bool			ret	= true;
+#if HAVE_PTHREAD
+	pthread_t		thread[SIMILAR_MAX_THREADS];
+	long			cnt_t;
+
+	njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (njobs > SIMILAR_MAX_THREADS)
+		njobs = SIMILAR_MAX_THREADS;
+	if (njobs > (long)(cg->number / SIMILAR_CHUNK))
+		njobs = cg->number / SIMILAR_CHUNK;
+	if (njobs < 1)
+		njobs = 1;
+#endif
+
+	memset((void *)&ctx, 0, sizeof(ctx));
+	memset((void *)job, 0, sizeof(job));
+	memset((void *)&all, 0, sizeof(all));
+
+	ctx.words	= (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	ctx.number	= cg->number;
+	ctx.threshold	= cg->opt_similar_dist;
+
+	if (!(sig = (uint64_t *)malloc(ctx.words * ctx.number * sizeof(uint64_t)))) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("%s", "no memory for glyph signatures");
+		return false;
+	}
+
+	for (cnt = 0; cnt < ctx.number; cnt++) {
+		for (cnt_w = 0; cnt_w < ctx.words; cnt_w++) {
+			word = 0;
+			memcpy(&word, (const char *)cg->rows + cnt * bytes
+					+ cnt_w * sizeof(uint64_t),
+					bytes - cnt_w * sizeof(uint64_t) < sizeof(uint64_t) ?
+					bytes - cnt_w * sizeof(uint64_t) : sizeof(uint64_t));
+			sig[cnt_w * ctx.number + cnt] = word;
+		}
+	}
+	ctx.sig = sig;
+
+	for (cnt_j = 0; cnt_j < (size_t)njobs; cnt_j++)
+		job[cnt_j].ctx = &ctx;
+
+#if HAVE_PTHREAD
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	/* the calling thread always takes the first job */
+	for (cnt_t = 1; cnt_t < njobs; cnt_t++)
+		if (pthread_create(&thread[cnt_t], NULL, _mkcg_similar_worker, &job[cnt_t]))
+			break;
+	njobs = cnt_t;
+
+	_mkcg_similar_worker(&job[0]);
+
+	for (cnt_t = 1; cnt_t < njobs; cnt_t++)
+		pthread_join(thread[cnt_t], NULL);
+
+	pthread_mutex_destroy(&ctx.lock);
+#else
+	_mkcg_similar_worker(&job[0]);
+#endif
+
+	for (cnt_j = 0; cnt_j < (size_t)njobs; cnt_j++) {
+		for (cnt = 0; ret && cnt < job[cnt_j].list.number; cnt++) {
+			_mkcg_similar_add(&all, job[cnt_j].list.pair[cnt].a,
+					job[cnt_j].list.pair[cnt].b,
+					job[cnt_j].list.pair[cnt].dist);
+			ret = !all.nomem;
+		}
+		ret = ret && !job[cnt_j].list.nomem;
+		if (job[cnt_j].list.pair) free(job[cnt_j].list.pair);
+	}
+
+	if (!ret) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("%s", "no memory for glyph pairs");
+		goto out;
+	}
+
+	qsort(all.pair, all.number, sizeof(_mkcg_similar_pair), _mkcg_similar_cmp);
+
+	if (cg->options & OPT_MKCG_VERBOSE)
+		INF("similar: %zu glyphs, %zu pairs within distance %u",
+				ctx.number, all.number, ctx.threshold);
+
+	if (cg->options & OPT_MKCG_JSON) {
+
+		OUT(cg, "{\"threshold\": %u, \"glyphs\": %zu, \"pairs\": [",
+				ctx.threshold, ctx.number);
+		for (cnt = 0; cnt < all.number; cnt++) {
+			OUT(cg, "%s\n  {\"distance\": %u, \"a\": ", cnt ? "," : "",
+					all.pair[cnt].dist);
+			mkcg_json_string(cg->out, cg->ch[all.pair[cnt].a].filename);
+			OUT(cg, "%s", ", \"b\": ");
+			mkcg_json_string(cg->out, cg->ch[all.pair[cnt].b].filename);
+			OUT(cg, "%s", "}");
+		}
+		OUT(cg, "%s", "\n]}\n");
+
+	} else {
+
+		for (cnt = 0; cnt < all.number; cnt++)
+			OUT(cg, "%u\t%s\t%s\n", all.pair[cnt].dist,
+					cg->ch[all.pair[cnt].a].filename,
+					cg->ch[all.pair[cnt].b].filename);
+
+	}
+
+out:
+	if (all.pair) free(all.pair);
+	free(sig);
+
+	return ret;
+}
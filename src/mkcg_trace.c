@@ -0,0 +1,134 @@
+/*
+ * Core functions to handle different PC/M character generator PROMs.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include "pcmtools.h"
+
+#include <time.h>
+
+/*
+ * Spans are kept in memory while the set is processed and written as
+ * Chrome trace-event JSON (chrome://tracing, Perfetto) at the end, so
+ * recording a span costs two clock reads and no I/O.  Without a trace
+ * file no clock is read and nothing is recorded at all.
+ */
+#define TRACE_CHUNK	1024
+
+uint64_t mkcg_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Record a span of FILE, whose glyph at the index GLYPH of the set it
+ * is.  The file is kept with the span, the set may grow and move
+ * behind it.
+ */
+void mkcg_trace_span(mkcg_cg *cg, const char *name, long glyph,
+		const char *file, uint64_t begin, uint64_t end)
+{
+	mkcg_trace_event *event;
+
+	if (cg->trace_number == cg->trace_alloc) {
+		event = (mkcg_trace_event *)realloc(cg->trace,
+				(cg->trace_alloc + TRACE_CHUNK)
+				* sizeof(mkcg_trace_event));
+		if (!event) {
+			cg->trace_lost++;
+			return;
+		}
+		cg->trace = event;
+		cg->trace_alloc += TRACE_CHUNK;
+	}
+
+	event = &cg->trace[cg->trace_number++];
+	event->name	= name;
+	event->glyph	= glyph;
+	event->file	= file;
+	event->begin	= begin;
+	event->end	= end;
+}
+
+/* Record a span that ends now, the glyph is in the set already. */
+void mkcg_trace_add(mkcg_cg *cg, const char *name, long glyph,
+		uint64_t begin)
+{
+	mkcg_trace_span(cg, name, glyph,
+			(glyph >= 0) && cg->number ?
+			cg->ch[glyph % cg->number].filename : (const char *)NULL,
+			begin, mkcg_trace_now());
+}
+
+/* Write all recorded spans as complete ("X") events, times in us. */
+bool mkcg_trace_write(mkcg_cg *cg)
+{
+	mkcg_trace_event	*event;
+	size_t			cnt;
+	long			pid = (long)getpid();
+	FILE			*fp;
+	bool			ret;
+
+	if (!(fp = fopen(cg->opt_trace_file, "w"))) {
+		if (!(cg->options & OPT_MKCG_QUIET))
+			ERR("can not open trace file: %s", cg->opt_trace_file);
+		return false;
+	}
+
+	fprintf(fp, "%s", "{\"traceEvents\": [");
+
+	for (cnt = 0; cnt < cg->trace_number; cnt++) {
+
+		event = &cg->trace[cnt];
+
+		fprintf(fp, "%s\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+				"\"ts\": %.3f, \"dur\": %.3f, \"pid\": %ld, \"tid\": %ld",
+				cnt ? "," : "", event->name,
+				event->glyph >= 0 ? "glyph" : event->file ? "file" : "action",
+				(event->begin - cg->trace_epoch) / 1000.0,
+				(event->end - event->begin) / 1000.0, pid, pid);
+
+		if ((event->glyph >= 0) && event->file) {
+			fprintf(fp, ", \"args\": {\"glyph\": %ld, \"file\": ",
+					event->glyph);
+			mkcg_json_string(fp, event->file);
+			fprintf(fp, "%s", "}");
+		}
+		else if (event->file) {
+			fprintf(fp, "%s", ", \"args\": {\"file\": ");
+			mkcg_json_string(fp, event->file);
+			fprintf(fp, "%s", "}");
+		}
+
+		fprintf(fp, "%s", "}");
+	}
+
+	fprintf(fp, "%s", "\n], \"displayTimeUnit\": \"ms\"}\n");
+
+	ret = !ferror(fp);
+	ret = (fclose(fp) == 0) && ret;
+
+	if (cg->options & OPT_MKCG_VERBOSE)
+		INF("trace: %zu events, %zu lost", cg->trace_number, cg->trace_lost);
+
+	return ret;
+}
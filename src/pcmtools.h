@@ -36,6 +36,12 @@
 # error missing POSIX operating system API
 #endif
 
+#if HAVE_STDINT_H
+# include <stdint.h>
+#else
+# error missing C99 integer types
+#endif
+
 #if HAVE_STDBOOL_H
 # include <stdbool.h>
 #else
@@ -52,6 +58,13 @@ typedef unsigned char _Bool;
 # define __bool_true_false_are_defined 1
 #endif
 
+#if HAVE_SYS_SDT_H
+# include <sys/sdt.h>
+# define MKCG_PROBE(NAME,GLYPH)	DTRACE_PROBE1(pcmtools, NAME, GLYPH)
+#else
+# define MKCG_PROBE(NAME,GLYPH)	do { } while (0)
+#endif
+
 #if defined(HAVE_X11_XPM_H) && defined(HAVE_LIBXPM)
 # include <X11/xpm.h>
 #else
@@ -59,7 +72,7 @@ typedef unsigned char _Bool;
 #endif
 
 
-#define OUT(FORMAT,...) fprintf(stdout, FORMAT, __VA_ARGS__)
+#define OUT(CG,FORMAT,...) fprintf((CG)->out, FORMAT, __VA_ARGS__)
 #define INF(FORMAT,...) fprintf(stderr, FORMAT "\n", __VA_ARGS__)
 #define ERR(FORMAT,...) fprintf(stderr, "%s:%d::%s(): " FORMAT "\n", \
 			__FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
@@ -73,49 +86,269 @@ typedef struct {
 	unsigned int	dot_color_id;
 
 	char		*filename;
+	char		*buffer;
+	size_t		size;
+
+	/* rows of a glyph from a container, no XPM to parse */
+	unsigned char	*packed;
+
+	/* span of the read, traced once the file has its place in the set */
+	uint64_t	read_begin;
+	uint64_t	read_end;
 
 } mkcg_ch;
 
+typedef struct {
+
+	unsigned char	*addr;
+	size_t		size;
+	bool		heap;	/* read into memory, not mapped */
+
+} mkcg_map;
+
+typedef struct {
+
+	unsigned int		ops;
+				#define MKCG_DERIVE_NEGATE	0x00000001
+				#define MKCG_DERIVE_UNDERLINE	0x00000002
+				#define MKCG_DERIVE_BOLD	0x00000004
+				#define MKCG_DERIVE_MIRROR	0x00000008
+				#define MKCG_DERIVE_DHTOP	0x00000010
+				#define MKCG_DERIVE_DHBOTTOM	0x00000020
+	unsigned int		ul_row;
+				#define MKCG_DERIVE_ULROW_LAST	(~0U)
+
+} mkcg_derive;
+
+typedef struct {
+
+	unsigned int		preset;
+				#define MKCG_LAYOUT_FORMULA	0
+				#define MKCG_LAYOUT_GLYPH	1
+				#define MKCG_LAYOUT_SCANLINE	2
+	unsigned int		select;		/* top bits, one EPROM each */
+	unsigned int		number;
+	struct {
+		unsigned int	field;
+				#define MKCG_LAYOUT_CHAR	0
+				#define MKCG_LAYOUT_BANK	1
+				#define MKCG_LAYOUT_ROW		2
+				#define MKCG_LAYOUT_BYTE	3
+				#define MKCG_LAYOUT_FIELDS	4
+		unsigned int	bits;
+	}			piece[32];
+
+} mkcg_layout;
+
+typedef struct {
+
+	const char		*name;
+	long			glyph;		/* -1 for a whole action */
+	const char		*file;		/* of the glyph, or NULL */
+	uint64_t		begin;		/* ns, CLOCK_MONOTONIC */
+	uint64_t		end;
+
+} mkcg_trace_event;
+
 typedef struct {
 
 	char			*progname;
 	char			*description;
 
+	/* all output of this context goes here, stdout by default */
+	FILE			*out;
+
 	unsigned int		bound_bits;
 	unsigned int		bound_bytes;
 	unsigned int		exp_ch_width;
 	unsigned int		exp_ch_hight;
 	unsigned int		exp_ch_max_color;
 	const char		*exp_ch_dot_color;
+	unsigned int		rom_chars;	/* 0 for the set size */
+	unsigned int		screen_cols;
+	unsigned int		screen_rows;
 
 	size_t			number;
 	mkcg_ch			*ch;
 
+	/* packed glyph table: banks * number glyphs of bound_bytes
+	 * rows, dots are 1 and right-aligned in exp_ch_width bits,
+	 * each row is an uint8_t, uint16_t or uint32_t by row_bytes */
+	size_t			banks;
+	unsigned int		row_bytes;
+	void			*rows;
+
+	/* mapped glyph set containers, rows may point into the first */
+	mkcg_map		*map;
+	size_t			map_number;
+	bool			map_rows;
+
 	unsigned int		options;
 				/* actions */
 				#define OPT_MKCG_BANNER		0x00000001
 				#define OPT_MKCG_HEXDUMP	0x00000002
 				#define OPT_MKCG_OVERVIEW	0x00000004
+				#define OPT_MKCG_RENDER		0x00000008
+				#define OPT_MKCG_LINT		0x00000010
+				#define OPT_MKCG_SIMILAR	0x00000020
+				#define OPT_MKCG_CONTAINER	0x00000040
 				#define OPT_MKCG_ACTIONMASK	( OPT_MKCG_BANNER \
 								| OPT_MKCG_HEXDUMP \
-								| OPT_MKCG_OVERVIEW )
+								| OPT_MKCG_OVERVIEW \
+								| OPT_MKCG_RENDER \
+								| OPT_MKCG_LINT \
+								| OPT_MKCG_SIMILAR \
+								| OPT_MKCG_CONTAINER )
 				/* memory manipulation */
 				#define OPT_MKCG_NEGATED	0x00010000	/* CG content */
 				#define OPT_MKCG_LEFTBOUND	0x00020000
+				#define OPT_MKCG_LITTLEENDIAN	0x00040000	/* wide rows */
 				/* output manipulation */
+				#define OPT_MKCG_JSON		0x10000000
 				#define OPT_MKCG_INVERSE	0x20000000
 				#define OPT_MKCG_QUIET		0x40000000
 				#define OPT_MKCG_VERBOSE	0x80000000
 	unsigned int		opt_overview_cols;
+	unsigned int		opt_render_format;
+				#define MKCG_RENDER_XPM		0
+				#define MKCG_RENDER_PBM		1
+	char			*opt_render_output;
+	size_t			opt_screen_number;
+	char			**opt_screen_files;
+	size_t			opt_derive_number;
+	mkcg_derive		*opt_derive;
+	unsigned int		opt_similar_dist;
+	mkcg_layout		*opt_layout;
+	size_t			opt_files_number;
+	char			**opt_files;
+	char			*opt_trace_file;
+	char			*opt_archive;
+
+	/* spans, only recorded with opt_trace_file */
+	mkcg_trace_event	*trace;
+	size_t			trace_number;
+	size_t			trace_alloc;
+	size_t			trace_lost;
+	uint64_t		trace_epoch;
 
 } mkcg_cg;
 
+#define MKCG_ROW_MASK(BITS)	((BITS) >= 32 ? 0xFFFFFFFFU : (1U << (BITS)) - 1)
+
+static inline uint32_t mkcg_row_get(const mkcg_cg *cg, size_t idx)
+{
+	switch (cg->row_bytes) {
+		case 1:  return ((const uint8_t *)cg->rows)[idx];
+		case 2:  return ((const uint16_t *)cg->rows)[idx];
+		default: return ((const uint32_t *)cg->rows)[idx];
+	}
+}
+
+static inline void mkcg_row_set(mkcg_cg *cg, size_t idx, uint32_t bits)
+{
+	switch (cg->row_bytes) {
+		case 1:  ((uint8_t *)cg->rows)[idx] = bits; break;
+		case 2:  ((uint16_t *)cg->rows)[idx] = bits; break;
+		default: ((uint32_t *)cg->rows)[idx] = bits; break;
+	}
+}
+
+/* Byte BYTE of an already encoded row in ROM order, MSB first by default. */
+static inline unsigned int mkcg_row_byte(const mkcg_cg *cg, uint32_t bits,
+		unsigned int byte)
+{
+	if (cg->options & OPT_MKCG_LITTLEENDIAN)
+		return (bits >> (8 * byte)) & 0xFF;
+	else
+		return (bits >> (8 * (cg->row_bytes - 1 - byte))) & 0xFF;
+}
+
+/*
+ * Trace one span of NAME around a glyph (its index) or a whole action
+ * (-1).  The USDT probes NAME_begin and NAME_end are single no-ops
+ * until perf or bpftrace attach; the span for the trace file is only
+ * timed when one was asked for.
+ */
+#define MKCG_TRACE_BEGIN(CG,NAME,GLYPH,TS) do { \
+		MKCG_PROBE(NAME##_begin, (long)(GLYPH)); \
+		(TS) = (CG)->opt_trace_file ? mkcg_trace_now() : 0; \
+	} while (0)
+
+#define MKCG_TRACE_END(CG,NAME,GLYPH,TS) do { \
+		MKCG_PROBE(NAME##_end, (long)(GLYPH)); \
+		if ((CG)->opt_trace_file) \
+			mkcg_trace_add((CG), #NAME, (long)(GLYPH), (TS)); \
+	} while (0)
+
+/* Call the FUNC_8, FUNC_16 or FUNC_32 specialisation by row storage. */
+#define MKCG_ROW_DISPATCH(CG,FUNC,...) do { \
+		switch ((CG)->row_bytes) { \
+			case 1:  FUNC##_8(__VA_ARGS__); break; \
+			case 2:  FUNC##_16(__VA_ARGS__); break; \
+			default: FUNC##_32(__VA_ARGS__); break; \
+		} \
+	} while (0)
+
+
+/* Status codes:
+ * null     if full success
+ * positive if partial success
+ * negative if failure
+ */
+#define PCMT_EXSTAT_DONE	(100)		/* nothing left to do */
+#define PCMT_EXSTAT_XPM_CE	(XpmColorError)	/* XpmColorError = 1 */
+#define PCMT_EXSTAT_OK		(XpmSuccess)	/* XpmSuccess = 0 */
+#define PCMT_EXSTAT_XPM_OF	(XpmOpenFailed)	/* XpmOpenFailed = -1 */
+#define PCMT_EXSTAT_XPM_FI	(XpmFileInvalid)/* XpmFileInvalid = -2 */
+#define PCMT_EXSTAT_XPM_NM	(XpmNoMemory)	/* XpmNoMemory = -3 */
+#define PCMT_EXSTAT_XPM_CF	(XpmColorFailed)/* XpmColorFailed = -4 */
+#define PCMT_EXSTAT_WRONGOPT	(-10)
+#define PCMT_EXSTAT_NOFILES	(-11)
+#define PCMT_EXSTAT_NOMEM	(-12)
+#define PCMT_EXSTAT_CONVERR	(-13)
+#define PCMT_EXSTAT_IOERR	(-14)
+#define PCMT_EXSTAT_CRITERR	(-20)
+
+void mkcg_init(mkcg_cg *cg);
+void mkcg_free(mkcg_cg *cg);
+void mkcg_report(mkcg_cg *cg, int status);
+int mkcg_getopt(mkcg_cg *cg, int argc, char **argv);
+int mkcg_execopt(mkcg_cg *cg);
 
-void mkcg_getopt(mkcg_cg *cg, int argc, char **argv);
-void mkcg_execopt(mkcg_cg *cg, int argc, char **argv);
+uint64_t mkcg_trace_now(void);
+void mkcg_trace_span(mkcg_cg *cg, const char *name, long glyph,
+		const char *file, uint64_t begin, uint64_t end);
+void mkcg_trace_add(mkcg_cg *cg, const char *name, long glyph,
+		uint64_t begin);
+bool mkcg_trace_write(mkcg_cg *cg);
+void mkcg_json_string(FILE *fp, const char *str);
 
+typedef int (*mkcg_io_done)(mkcg_cg *cg, mkcg_ch *file, unsigned int count,
+		void *arg);
+int mkcg_io_readall(mkcg_cg *cg, char **files, size_t number,
+		mkcg_io_done done, void *arg);
+bool mkcg_archive_read(mkcg_cg *cg);
+unsigned long mkcg_archive_code(const char *path);
+bool mkcg_container_probe(const char *path);
+bool mkcg_container_read(mkcg_cg *cg, const char *path);
+bool mkcg_container_head(const char *head, size_t size);
+bool mkcg_container_append(mkcg_cg *cg, mkcg_ch *file, size_t room);
+uint32_t mkcg_container_row(mkcg_cg *cg, const unsigned char *packed,
+		unsigned int row);
+void mkcg_container_close(mkcg_cg *cg);
+bool mkcg_out_container(mkcg_cg *cg);
 bool mkcg_isvalidch(XpmImage *image, mkcg_cg *cg, mkcg_ch *ch);
-bool mkcg_out_banner(mkcg_cg *cg, mkcg_ch *ch);
-bool mkcg_out_xxd(mkcg_cg *cg, mkcg_ch *ch, unsigned int addr);
+bool mkcg_lint(mkcg_cg *cg, int argc, char **argv);
+bool mkcg_pack(mkcg_cg *cg);
+bool mkcg_derive_parse(mkcg_cg *cg, char *spec);
+bool mkcg_derive_banks(mkcg_cg *cg);
+bool mkcg_out_banner(mkcg_cg *cg, size_t glyph);
+bool mkcg_out_xxd(mkcg_cg *cg, size_t glyph, unsigned int addr);
+bool mkcg_layout_parse(mkcg_cg *cg, char *spec);
+bool mkcg_out_layout(mkcg_cg *cg);
 bool mkcg_out_xpm(mkcg_cg *cg);
+bool mkcg_out_xpmimage(mkcg_cg *cg, XpmImage *image);
+bool mkcg_screen_parse(mkcg_cg *cg, char *pattern);
+bool mkcg_out_screen(mkcg_cg *cg);
+bool mkcg_similar(mkcg_cg *cg);
 
@@ -0,0 +1,237 @@
+#!/bin/sh
+
+#
+# Performance regression gate of the smoke test suite
+#
+# Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+# MA  02110-1301, USA.
+#
+
+#
+# usage:
+#
+# check-perf.sh [--update] <objdir> <baseline> <results>
+#
+# Generate a large glyph set for every character generator and glyph
+# size below, encode it with mkcg.<cg> --hexdump a few times and compare
+# the best throughput per CPU second and the peak RSS against <baseline>.
+# The figures go to <results> as tab separated lines, one per set and
+# metric:
+#
+#   <set>  <metric>  <value>  <baseline>  <limit>  <verdict>
+#
+# A set is named by its tool, with @WIDTHxHIGHT for a --geometry.  The
+# wide sets go through the 16 bit row path, 16x16 and 8x32 have the
+# same number of dots, so they compare it with the 8 bit one.
+#
+# The baseline follows the code, so a set whose memory grows with the
+# glyphs is also held to a budget of its own: the peak RSS above that
+# of a run over one glyph, per glyph, may be PERF_RSS_GLYPH times the
+# parsed image of a glyph (a 32 bit pixel per dot) at most.  It is the
+# rss_per_glyph line, in bytes, with the image size as its baseline.
+#
+# The exit status is 1 if any verdict is "fail".  With --update the
+# measured figures are written to <baseline> instead, nothing fails.
+#
+# Environment:
+#
+#   PERFRUN             the perfrun helper (default ./perfrun)
+#   PERF_GLYPHS         glyphs in each generated set (default 16384)
+#   PERF_RUNS           runs of each set, the best one counts (default 7)
+#   PERF_TOLERANCE_TIME allowed throughput loss in percent (default 30)
+#   PERF_TOLERANCE_RSS  allowed peak RSS growth in percent (default 10)
+#   PERF_RSS_GLYPH      RSS budget per glyph in parsed images (default 4)
+#
+
+set -e
+
+UPDATE=no
+if [ "x$1" = "x--update" ]; then
+	UPDATE=yes
+	shift
+fi
+
+if [ $# -ne 3 ]; then
+	echo "usage: $0 [--update] <objdir> <baseline> <results>" >&2
+	exit 2
+fi
+
+OBJDIR=$1
+BASELINE=$2
+RESULTS=$3
+
+PERFRUN=${PERFRUN:-./perfrun}
+PERF_GLYPHS=${PERF_GLYPHS:-16384}
+PERF_RUNS=${PERF_RUNS:-7}
+PERF_TOLERANCE_TIME=${PERF_TOLERANCE_TIME:-30}
+PERF_TOLERANCE_RSS=${PERF_TOLERANCE_RSS:-10}
+PERF_RSS_GLYPH=${PERF_RSS_GLYPH:-4}
+
+# the set sizes of the baseline and this run must match
+FORMAT="glyphs ${PERF_GLYPHS}"
+
+TMPDIR=`mktemp -d "${TMPDIR:-/tmp}/mkcg-perf.XXXXXX"`
+trap 'rm -rf "$TMPDIR"' 0
+trap 'exit 1' 1 2 15
+
+#
+# usage:
+#
+# generate <dir> <width> <hight> [<glyphs>]
+#
+# Write PERF_GLYPHS, or <glyphs>, pixmaps of random dots in the
+# dimensions of the character generator.  The pattern comes from a
+# fixed LCG, so every host encodes the same set.
+#
+generate() {
+	mkdir -p "$1"
+	awk -v dir="$1" -v n="${4:-$PERF_GLYPHS}" -v w="$2" -v h="$3" 'BEGIN {
+		seed = 1
+		for (glyph = 0; glyph < n; glyph++) {
+			file = sprintf("%s/glyph_%05d.xpm", dir, glyph)
+			printf("/* XPM */\nstatic char *glyph_%05d[]={\n", glyph) > file
+			printf("\"%d %d 2 1\",\n\". c None\",\n\"# c #000000\",\n", w, h) > file
+			for (row = 0; row < h; row++) {
+				line = ""
+				for (col = 0; col < w; col++) {
+					seed = (seed * 69069 + 1) % 4294967296
+					line = line (int(seed / 65536) % 2 ? "#" : ".")
+				}
+				printf("\"%s\"%s\n", line, row < h - 1 ? "," : "};") > file
+			}
+			close(file)
+		}
+	}'
+}
+
+#
+# usage:
+#
+# measure <tool> <dir> [<option>...]
+#
+# Print the least CPU time in microseconds and the largest peak RSS in
+# KiB of PERF_RUNS encoder runs over the set in <dir>.
+#
+measure() {
+	tool=$1
+	dir=$2
+	shift 2
+	run=0
+	while [ $run -lt $PERF_RUNS ]; do
+		"$PERFRUN" "$tool" --quiet --hexdump "$@" "$dir"/*.xpm
+		run=`expr $run + 1`
+	done | awk '
+		NR == 1 || $1 < cpu { cpu = $1 }
+		NR == 1 || $2 > rss { rss = $2 }
+		END { if (NR) print cpu, rss }'
+}
+
+: > "$TMPDIR/measured"
+: > "$TMPDIR/budget"
+
+# tool, glyph width and hight, --geometry or - for the board default
+while read TOOL WIDTH HIGHT GEOMETRY <&3; do
+	if [ "x$GEOMETRY" = "x-" ]; then
+		SET=$TOOL
+		OPTION=
+	else
+		SET=$TOOL@$GEOMETRY
+		OPTION=--geometry=$GEOMETRY
+	fi
+
+	generate "$TMPDIR/$SET" $WIDTH $HIGHT
+	generate "$TMPDIR/$SET.one" $WIDTH $HIGHT 1
+	set -- `measure "$OBJDIR/$TOOL" "$TMPDIR/$SET" $OPTION` \
+		`measure "$OBJDIR/$TOOL" "$TMPDIR/$SET.one" $OPTION`
+	if [ $# -ne 4 ]; then
+		echo "$0: $SET: no measurement" >&2
+		exit 1
+	fi
+
+	# glyphs per CPU second out of the best run
+	echo "$SET glyphs_per_sec `expr $PERF_GLYPHS \* 1000000 / $1`" \
+		>> "$TMPDIR/measured"
+	echo "$SET peak_rss_kib $2" >> "$TMPDIR/measured"
+
+	# RSS in bytes each glyph adds, against its parsed image
+	echo "$SET rss_per_glyph `expr \( $2 - $4 \) \* 1024 / $PERF_GLYPHS`" \
+		"`expr $WIDTH \* $HIGHT \* 4`" >> "$TMPDIR/budget"
+done 3<<EOF
+mkcg.6416 7 8 -
+mkcg.vid2k 8 10 -
+mkcg.vid2k 8 32 8x32
+mkcg.vid2k 16 16 16x16
+EOF
+
+if [ $UPDATE = yes ]; then
+	{
+		echo "# mkcg check-perf baseline, $FORMAT"
+		echo "# set	metric	value"
+		awk '{ printf("%s\t%s\t%s\n", $1, $2, $3) }' "$TMPDIR/measured"
+	} > "$BASELINE"
+	cat "$BASELINE"
+	exit 0
+fi
+
+if ! grep -q "^# mkcg check-perf baseline, $FORMAT\$" "$BASELINE"; then
+	echo "$0: $BASELINE: not a baseline for $FORMAT" >&2
+	exit 1
+fi
+
+#
+# Throughput may drop and RSS may grow by their tolerance, a metric
+# missing from the baseline is reported but can not fail.  The budget
+# lines carry their own baseline.
+#
+awk -v tol_time="$PERF_TOLERANCE_TIME" -v tol_rss="$PERF_TOLERANCE_RSS" \
+    -v rss_glyph="$PERF_RSS_GLYPH" \
+    -v format="$FORMAT" -v runs="$PERF_RUNS" '
+	BEGIN {
+		printf("# mkcg check-perf results, %s, runs %d\n", format, runs)
+		printf("# set\tmetric\tvalue\tbaseline\tlimit\tverdict\n")
+	}
+	FNR == NR {
+		if ($0 !~ /^#/ && NF == 3)
+			base[$1 " " $2] = $3
+		next
+	}
+	NF == 4 {
+		limit = $4 * rss_glyph
+		printf("%s\t%s\t%s\t%s\t%s\t%s\n", $1, $2, $3, $4, limit,
+				$3 <= limit ? "pass" : "fail")
+		next
+	}
+	{
+		key = $1 " " $2
+		if (!(key in base)) {
+			printf("%s\t%s\t%s\t-\t-\tnew\n", $1, $2, $3)
+			next
+		}
+		if ($2 == "glyphs_per_sec") {
+			limit = int(base[key] * (100 - tol_time) / 100)
+			verdict = $3 >= limit ? "pass" : "fail"
+		} else {
+			limit = int(base[key] * (100 + tol_rss) / 100)
+			verdict = $3 <= limit ? "pass" : "fail"
+		}
+		printf("%s\t%s\t%s\t%s\t%s\t%s\n",
+				$1, $2, $3, base[key], limit, verdict)
+	}' "$BASELINE" "$TMPDIR/measured" "$TMPDIR/budget" > "$RESULTS"
+
+cat "$RESULTS"
+
+! grep -q '	fail$' "$RESULTS"
@@ -0,0 +1,93 @@
+/*
+ * Run one command and report its CPU time and peak memory.
+ *
+ * Copyright (C) 2002-2020  Stephan Linz <linz@li-pro.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+ * usage: perfrun COMMAND [ARG...]
+ *
+ * Run COMMAND with its output thrown away and print one line
+ *
+ *   <cpu time in microseconds> <peak resident set size in KiB>
+ *
+ * Both come from wait4(2) of just this child, so neither the shell nor
+ * an earlier run is counted.  The CPU time is user plus system time,
+ * what a busy build host steals from the run does not show up in it.
+ * Nothing is printed if COMMAND fails, a failed run must not go into
+ * the figures.
+ */
+int main(int argc, char **argv)
+{
+	struct rusage	usage;
+	long long	cpu;
+	pid_t		pid;
+	int		status, fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s COMMAND [ARG...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if ((pid = fork()) < 0) {
+		fprintf(stderr, "%s: fork: %s\n", argv[0], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (!pid) {
+		if ((fd = open("/dev/null", O_WRONLY)) >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			close(fd);
+		}
+		execvp(argv[1], &argv[1]);
+		fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+		_exit(127);
+	}
+
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			fprintf(stderr, "%s: wait4: %s\n", argv[0], strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "%s: %s: failed with status 0x%x\n",
+				argv[0], argv[1], status);
+		return EXIT_FAILURE;
+	}
+
+	cpu = (long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+	/* ru_maxrss is in KiB on Linux and the BSDs */
+	printf("%lld %ld\n", cpu, usage.ru_maxrss);
+
+	return EXIT_SUCCESS;
+}